@@ -9,11 +9,18 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "avl_tree.h"
 
 #define max(x,y) ((x) < (y) ? (y) : (x))
 
+#ifdef INTERVAL_TREE_STATS
+#define STATS_ADD(me, field, n) ((me)->field += (n))
+#else
+#define STATS_ADD(me, field, n) do {} while (0)
+#endif
+
 static int __child_l(const int idx)
 {
   return idx * 2 + 1;
@@ -66,13 +73,36 @@ void avltree_print2(avltree_t* me)
   printf("\n");
 }
 
-static void __enlarge(avltree_t* me)
+static void *__default_allocate(size_t size, void *ctx __attribute__((unused)))
+{
+  return malloc(size);
+}
+
+static void __default_release(void *ptr, size_t size __attribute__((unused)), void *ctx __attribute__((unused)))
+{
+  free(ptr);
+}
+
+static const avltree_allocator_t default_allocator = { __default_allocate, __default_release, NULL };
+
+/* An array of size nodes, all of them empty */
+static node_t *__alloc_nodes(avltree_t* me, int size)
+{
+  node_t *array_n = me->allocator.allocate(size * sizeof(node_t), me->allocator.ctx);
+
+  if (array_n)
+    memset(array_n, 0, size * sizeof(node_t));
+  return array_n;
+}
+
+static int __grow(avltree_t* me, int size)
 {
   int ii, end;
   node_t *array_n;
 
-  /* double capacity */
-  array_n = calloc(me->size * 2, sizeof(node_t));
+  array_n = __alloc_nodes(me, size);
+  if (!array_n)
+    return -1;
 
   /* copy old data across to new array */
   for (ii = 0, end = me->size /*avltree_count(me)*/; ii < end; ii++) {
@@ -80,32 +110,89 @@ static void __enlarge(avltree_t* me)
       memcpy(&array_n[ii], &me->nodes[ii], sizeof(node_t));
   }
 
+  STATS_ADD(me, enlargements, 1);
+  STATS_ADD(me, bytes_copied, me->size * sizeof(node_t));
+
   /* swap arrays */
-  free(me->nodes);
+  me->allocator.release(me->nodes, me->size * sizeof(node_t), me->allocator.ctx);
   me->nodes = array_n;
-  me->size *= 2;
+  me->size = size;
+  return 0;
+}
+
+static int __enlarge(avltree_t* me)
+{
+  /* double capacity */
+  return __grow(me, me->size ? me->size * 2 : 1);
+}
+
+static int __depth(int idx)
+{
+  int d;
+
+  for (d = 0, idx++; idx > 1; idx >>= 1, d++);
+  return d;
+}
+
+/* 1 if the array holds every position of the level "depth" */
+static int __level_fits(avltree_t* me, int depth)
+{
+  return me->size >= (2 << depth) - 1;
+}
+
+/* Make sure that the array holds every position of the level "depth". Keeping whole
+ * levels allocated guarantees that a rotation never moves a subtree out of the array.
+ * Returns -1 if the memory could not be allocated. */
+static int __reserve_level(avltree_t* me, int depth)
+{
+  while (!__level_fits(me, depth)) {
+    if (__enlarge(me))
+      return -1;
+  }
+  return 0;
 }
 
 avltree_t* avltree_new(int size, long (*cmp)(
                          const void *e1,
                          const void *e2))
+{
+  return avltree_new_with_allocator(size, cmp, NULL);
+}
+
+avltree_t* avltree_new_with_allocator(int size, long (*cmp)(const void *e1, const void *e2),
+                                      const avltree_allocator_t *allocator)
 {
   avltree_t* me;
 
   assert(cmp);
 
-  me        = calloc(1, sizeof(avltree_t));
+  if (!allocator)
+    allocator = &default_allocator;
+  me = allocator->allocate(sizeof(avltree_t), allocator->ctx);
+  if (!me)
+    return NULL;
+  memset(me, 0, sizeof(avltree_t));
+  me->allocator = *allocator;
   me->size  = size;
-  me->nodes = calloc(me->size, sizeof(node_t));
+  me->nodes = __alloc_nodes(me, me->size);
   me->cmp   = cmp;
+  if (!me->nodes) {
+    allocator->release(me, sizeof(avltree_t), allocator->ctx);
+    return NULL;
+  }
   return me;
 }
 
+int avltree_reserve(avltree_t* me, int size)
+{
+  return size > me->size ? __grow(me, size) : 0;
+}
+
 void avltree_free(avltree_t* me)
 {
   if (me) { // Ensure that we are not accesing me->size if me is null.
-    free(me->nodes);
-    free(me);
+    me->allocator.release(me->nodes, me->size * sizeof(node_t), me->allocator.ctx);
+    me->allocator.release(me, sizeof(avltree_t), me->allocator.ctx);
   }
 }
 
@@ -131,9 +218,26 @@ static int __height(avltree_t* me, int idx)
 {
   if (idx >= me->size) return 0;
   if (!me->nodes[idx].key) return 0;
-  return max(
-           __height(me, __child_l(idx)) + 1,
-           __height(me, __child_r(idx)) + 1);
+  return me->nodes[idx].height;
+}
+
+static void __fix_height(avltree_t* me, int idx)
+{
+  me->nodes[idx].height = max(
+                            __height(me, __child_l(idx)),
+                            __height(me, __child_r(idx))) + 1;
+}
+
+static int __balance(avltree_t* me, int idx)
+{
+  return __height(me, __child_l(idx)) - __height(me, __child_r(idx));
+}
+
+static int __update(avltree_t* me, int idx)
+{
+  if (me->update_callback)
+    return me->update_callback(idx, me->update_callback_user);
+  return 0;
 }
 
 int avltree_height(avltree_t* me)
@@ -141,50 +245,129 @@ int avltree_height(avltree_t* me)
   return __height(me, 0);
 }
 
-static void __shift_up(avltree_t* me, int idx, int towards)
-{
-  if (idx >= me->size || towards >= me->size) return;
-  if (!me->nodes[idx].key)    return;
+/**
+ * Move the subtree rooted at idx to towards, which is at a lower or the same depth.
+ * Parents are moved before their children. When idx is the left child of towards
+ * the right children must be moved first (right_first) so that no position is
+ * overwritten before being moved, and the opposite for a right child.
+ * An empty source leaves the destination empty. */
+static void __shift_up(avltree_t* me, int idx, int towards, int right_first)
+{
+  if (towards >= me->size) return;
+  if (idx >= me->size || !me->nodes[idx].key) {
+    me->nodes[towards].key = NULL;
+    return;
+  }
 
   memcpy(&me->nodes[towards], &me->nodes[idx], sizeof(node_t));
   if (me->shift_up_callback) {
     me->shift_up_callback( idx, towards, me->shift_up_callback_user);
   }
   me->nodes[idx].key = NULL;
-  __shift_up(me, __child_l(idx), __child_l(towards));
-  __shift_up(me, __child_r(idx), __child_r(towards));
+  if (right_first) {
+    __shift_up(me, __child_r(idx), __child_r(towards), right_first);
+    __shift_up(me, __child_l(idx), __child_l(towards), right_first);
+  } else {
+    __shift_up(me, __child_l(idx), __child_l(towards), right_first);
+    __shift_up(me, __child_r(idx), __child_r(towards), right_first);
+  }
 }
 
-static void __shift_down(avltree_t* me, int idx, int towards)
+/**
+ * Move the subtree rooted at idx one level down, towards being one of its children.
+ * Children are moved before their parents, starting by the side of towards. */
+static void __shift_down(avltree_t* me, int idx, int towards, int right_first)
 {
-  if (idx >= me->size || towards >= me->size) return;
-  if (!me->nodes[idx].key)    return;
+  if (idx >= me->size || !me->nodes[idx].key)    return;
+  assert(towards < me->size);
 
-  __shift_down(me, __child_l(idx), __child_l(towards));
-  __shift_down(me, __child_r(idx), __child_r(towards));
+  if (right_first) {
+    __shift_down(me, __child_r(idx), __child_r(towards), right_first);
+    __shift_down(me, __child_l(idx), __child_l(towards), right_first);
+  } else {
+    __shift_down(me, __child_l(idx), __child_l(towards), right_first);
+    __shift_down(me, __child_r(idx), __child_r(towards), right_first);
+  }
   memcpy(&me->nodes[towards], &me->nodes[idx], sizeof(node_t));
 
   if (me->shift_down_callback) {
     me->shift_down_callback( idx, towards, me->shift_down_callback_user);
   }
+  me->nodes[idx].key = NULL;
 }
 
-void avltree_rotate_right(avltree_t* me, int idx)
+/* Move a single node, leaving its children where they are */
+static void __move(avltree_t* me, int idx, int towards,
+                   void (*callback)(int, int, void *), void *user)
 {
+  memcpy(&me->nodes[towards], &me->nodes[idx], sizeof(node_t));
+  if (callback)
+    callback(idx, towards, user);
+  me->nodes[idx].key = NULL;
+}
+
+/* X (idx) becomes the right child of its left child Y. The array is never grown here, so the
+ * callbacks do not see it change in the middle of a rotation: the subtree that goes down is
+ * the shorter one, which fits in the levels reserved by avltree_insert. Returns -1 (and
+ * does nothing) if it does not fit anyway. */
+static int __rotate_right(avltree_t* me, int idx)
+{
+  int l = __child_l(idx), r = __child_r(idx);
+
+  if (!__level_fits(me, __depth(r) + __height(me, r)))
+    return -1;
+  STATS_ADD(me, rotations, 1);
+
   /* A Partial
    * Move X out of the way so that Y can take its spot */
-  __shift_down(me, __child_r(idx), __child_r(__child_r(idx)));
-  memcpy(&me->nodes[__child_r(idx)], &me->nodes[idx], sizeof(node_t));
-  if (me->shift_up_callback)
-    me->shift_up_callback( idx, __child_r(idx), me->shift_up_callback_user);
-  /* B */
-  if ( __child_r(__child_l(idx)) < me->size) {
-    __shift_down(me, __child_r(__child_l(idx)), __child_l(__child_r(idx)));
-    me->nodes[__child_r(__child_l(idx))].key = NULL;
-  }
+  __shift_down(me, r, __child_r(r), 1);
+  __move(me, idx, r, me->shift_down_callback, me->shift_down_callback_user);
+  /* B
+   * Y's right child becomes X's left child */
+  __shift_up(me, __child_r(l), __child_l(r), 0);
   /* A Final
    * Move Y into X's old spot */
-  __shift_up(me, __child_l(idx), idx);
+  __move(me, l, idx, me->shift_up_callback, me->shift_up_callback_user);
+  __shift_up(me, __child_l(l), l, 1);
+
+  __fix_height(me, r);
+  __fix_height(me, idx);
+  __update(me, r);
+  __update(me, idx);
+  return 0;
+}
+
+/* X (idx) becomes the left child of its right child Y. See __rotate_right. */
+static int __rotate_left(avltree_t* me, int idx)
+{
+  int l = __child_l(idx), r = __child_r(idx);
+
+  if (!__level_fits(me, __depth(l) + __height(me, l)))
+    return -1;
+  STATS_ADD(me, rotations, 1);
+
+  /* A Partial
+   * Move X out of the way so that Y can take its spot */
+  __shift_down(me, l, __child_l(l), 0);
+  __move(me, idx, l, me->shift_down_callback, me->shift_down_callback_user);
+  /* B
+   * Y's left child becomes X's right child */
+  __shift_up(me, __child_l(r), __child_r(l), 0);
+  /* A Final
+   * Move Y into X's old spot */
+  __move(me, r, idx, me->shift_up_callback, me->shift_up_callback_user);
+  __shift_up(me, __child_r(r), r, 0);
+
+  __fix_height(me, l);
+  __fix_height(me, idx);
+  __update(me, l);
+  __update(me, idx);
+  return 0;
+}
+
+int avltree_rotate_right(avltree_t* me, int idx)
+{
+  return __rotate_right(me, idx);
 }
 
 void* avltree_get(avltree_t* me, const void* k)
@@ -218,6 +401,26 @@ void* avltree_get(avltree_t* me, const void* k)
   return NULL;
 }
 
+int avltree_get_idx(avltree_t* me, const void* k)
+{
+  int i;
+
+  for (i = 0; i < me->size && me->nodes[i].key; ) {
+    long r = me->cmp(me->nodes[i].key, k);
+
+    if (r == 0) {
+      return i;
+    } else if (r < 0) {
+      i = __child_l(i);
+    } else {
+      i = __child_r(i);
+    }
+  }
+
+  /* couldn't find it */
+  return -1;
+}
+
 void* avltree_get_from_idx(avltree_t* me, int idx)
 {
   if (idx < me->size) {
@@ -238,58 +441,51 @@ void set_shift_down_callback(avltree_t* me, void (*shift_down_callback)(int new_
   me->shift_down_callback_user = user;
 }
 
-void avltree_rotate_left(avltree_t* me, int idx)
+void set_update_callback(avltree_t* me, int (*update_callback)(int idx, void *user), void *user)
 {
-  int p;
-
-  p = __parent(idx);
-
-  /* A Partial
-   * Move Y out of the way so that X can take its spot */
-  __shift_down(me, __child_l(p), __child_l(__child_l(p)));
-  memcpy(&me->nodes[__child_l(p)], &me->nodes[p], sizeof(node_t));
-
-  if (me->shift_down_callback)
-    me->shift_down_callback( p, __child_l(p), me->shift_up_callback_user);
-  /* B */
-  __shift_down(me, __child_l(idx), __child_r(__child_l(p)));
-  me->nodes[__child_l(idx)].key = NULL;
-
-  /* A Final
-   * Move Y into X's old spot */
-  __shift_up(me, idx, p);
+  me->update_callback = update_callback;
+  me->update_callback_user = user;
 }
 
-static void __rebalance(avltree_t* me, int idx)
+int avltree_rotate_left(avltree_t* me, int idx)
 {
+  return __rotate_left(me, __parent(idx));
+}
 
+/**
+ * Walk from idx to the root restoring the AVL property. The walk stops as soon as
+ * the height of a node and its augmented data (update callback) do not change,
+ * since nothing above it can change either. It never stops at or below position until, whose content might be new. */
+static void __rebalance(avltree_t* me, int idx, int until)
+{
   while (1) {
-    if (2 <= __height(me, __child_l(idx)) - __height(me, __child_r(idx))) {
-      int bf_l;
-
-      bf_l = __height(me, __child_l(__child_l(idx))) -
-             __height(me, __child_r(__child_l(idx)));
-
-      if (bf_l == -1) {
-        avltree_rotate_left(me, __child_l(idx));
-        avltree_rotate_right(me, __child_l(idx));
-      } else {
-        avltree_rotate_right(me, __child_l(idx));
-      }
-    }  else if (-2 >= __height(me, __child_l(idx)) - __height(me, __child_r(idx))) {
-      int bf_r;
-
-      bf_r = __height(me, __child_l(__child_r(idx))) -
-             __height(me, __child_r(__child_r(idx)));
+    int old_height, changed, rotated, bf;
+
+    old_height = me->nodes[idx].height;
+    bf = __balance(me, idx);
+
+    /* A rotation that does not fit in the array is skipped: the tree is less balanced,
+     * but still ordered and augmented */
+    rotated = 0;
+    if (2 <= bf) {
+      if (__balance(me, __child_l(idx)) < 0)
+        __rotate_left(me, __child_l(idx));
+      rotated = !__rotate_right(me, idx);
+    } else if (-2 >= bf) {
+      if (__balance(me, __child_r(idx)) > 0)
+        __rotate_right(me, __child_r(idx));
+      rotated = !__rotate_left(me, idx);
+    }
 
-      if (bf_r == -1) {
-        avltree_rotate_left(me, __child_r(idx));
-      } else {
-        avltree_rotate_right(me, __child_r(idx));
-        avltree_rotate_left(me, __child_r(idx));
-      }
+    if (rotated) {
+      changed = 1;
+    } else {
+      __fix_height(me, idx);
+      changed = __update(me, idx);
     }
+
     if (0 == idx) break;
+    if (idx < until && !changed && old_height == me->nodes[idx].height) break;
     idx = __parent(idx);
   }
 }
@@ -297,7 +493,7 @@ static void __rebalance(avltree_t* me, int idx)
 
 void rebalance(avltree_t* me, int position)
 {
-  return  __rebalance(me, __parent(position));
+  __rebalance(me, __parent(position), position);
 }
 
 static int __previous_ordered_node(avltree_t* me, int idx)
@@ -331,7 +527,7 @@ void* avltree_remove(avltree_t* me, void* k)
 
     if (r == 0) {
       /* replacement */
-      int rep;
+      int rep, from;
 
       me->count -= 1;
 
@@ -339,19 +535,23 @@ void* avltree_remove(avltree_t* me, void* k)
 
       rep = __previous_ordered_node(me, i);
       if (-1 == rep) {
-        /* make sure the node is now blank */
-        n->key = NULL;
+        /* no left child: the right subtree takes the place of the node
+         * (or the node is now blank if it was a leaf) */
+        __shift_up(me, __child_r(i), i, 0);
+        from = i;
       } else {
-        /* have r's left node become right node of r's parent.
-         * NOTE: r by definition shouldn't have a right child */
-        __shift_up(me, __child_l(rep), __child_r(__parent(rep)));
+        /* have rep replace deleted node */
+        __move(me, rep, i, me->shift_up_callback, me->shift_up_callback_user);
 
-        /* have r replace deleted node */
-        __shift_up(me, rep, i);
+        /* have rep's left node take its place.
+         * NOTE: rep by definition doesn't have a right child */
+        __shift_up(me, __child_l(rep), rep, 1);
+        from = rep;
       }
 
-      if (i != 0)
-        __rebalance(me, __parent(i));
+      /* i holds a new key, so the walk cannot stop below it */
+      if (from != 0)
+        __rebalance(me, __parent(from), i);
 
       return k;
     } else if (r < 0) {
@@ -367,6 +567,101 @@ void* avltree_remove(avltree_t* me, void* k)
   return NULL;
 }
 
+static int __build(avltree_t* me, void **keys, void **vals, int *slots, int lo, int hi, int idx)
+{
+  int mid, hl, hr;
+
+  if (lo > hi) return 0;
+
+  mid = lo + (hi - lo) / 2;
+  me->nodes[idx].key = keys[mid];
+  me->nodes[idx].val = vals ? vals[mid] : NULL;
+  if (slots)
+    slots[mid] = idx;
+
+  hl = __build(me, keys, vals, slots, lo, mid - 1, __child_l(idx));
+  hr = __build(me, keys, vals, slots, mid + 1, hi, __child_r(idx));
+  me->nodes[idx].height = max(hl, hr) + 1;
+  return me->nodes[idx].height;
+}
+
+#define BUILD_GRAIN 32768 /**< Smaller subtrees are not worth a thread */
+
+struct _build_args_t {
+  avltree_t* me;
+  void **keys, **vals;
+  int *slots;
+  int lo, hi, idx;
+  int threads;          /**< Available for the subtree */
+  int height;           /**< Of the built subtree */
+};
+
+/* __build that lays out the left subtree in another thread while this one does the right one */
+static void *__build_parallel(void *p)
+{
+  struct _build_args_t *a = p, l, r;
+  pthread_t thread;
+  int mid, forked;
+
+  if (a->threads <= 1 || a->hi - a->lo < BUILD_GRAIN) {
+    a->height = __build(a->me, a->keys, a->vals, a->slots, a->lo, a->hi, a->idx);
+    return NULL;
+  }
+
+  mid = a->lo + (a->hi - a->lo) / 2;
+  a->me->nodes[a->idx].key = a->keys[mid];
+  a->me->nodes[a->idx].val = a->vals ? a->vals[mid] : NULL;
+  if (a->slots)
+    a->slots[mid] = a->idx;
+
+  l = r = *a;
+  l.hi = mid - 1;
+  l.idx = __child_l(a->idx);
+  l.threads = a->threads / 2;
+  r.lo = mid + 1;
+  r.idx = __child_r(a->idx);
+  r.threads = a->threads - l.threads;
+  forked = !pthread_create(&thread, NULL, __build_parallel, &l);
+  if (!forked)
+    __build_parallel(&l);
+  __build_parallel(&r);
+  if (forked)
+    pthread_join(thread, NULL);
+
+  a->height = max(l.height, r.height) + 1;
+  a->me->nodes[a->idx].height = a->height;
+  return NULL;
+}
+
+int avltree_build(avltree_t* me, void **keys, void **vals, int n, int *slots)
+{
+  return avltree_build_parallel(me, keys, vals, n, slots, 1);
+}
+
+int avltree_build_parallel(avltree_t* me, void **keys, void **vals, int n, int *slots, int nthreads)
+{
+  struct _build_args_t a = { me, keys, vals, slots, 0, n - 1, 0, nthreads, 0 };
+  int needed, size;
+
+  /* a perfectly balanced tree of n nodes fills the first ceil(log2(n+1)) levels */
+  for (needed = 1; needed < n; needed = needed * 2 + 1);
+
+  for (size = me->size; size < needed; size *= 2);
+  if (size != me->size) {
+    node_t *array_n = __alloc_nodes(me, size);
+    if (!array_n) return -1;
+    me->allocator.release(me->nodes, me->size * sizeof(node_t), me->allocator.ctx);
+    me->nodes = array_n;
+    me->size  = size;
+  } else {
+    memset(me->nodes, 0, me->size * sizeof(node_t));
+  }
+
+  __build_parallel(&a);
+  me->count = n;
+  return 0;
+}
+
 void avltree_empty(avltree_t* me)
 {
   int i;
@@ -386,11 +681,7 @@ int avltree_insert(avltree_t* me, void* k, void* v)
 
     /* found an empty slot */
     if (!n->key) {
-      n->key = k;
-      n->val = v;
-      me->count += 1;
-
-      return i;
+      break;
     }
 
     long r = me->cmp(n->key, k);
@@ -408,11 +699,15 @@ int avltree_insert(avltree_t* me, void* k, void* v)
     }
   }
 
-  /* we're outside of the loop because we need to enlarge */
-  __enlarge(me);
+  /* we're outside of the loop because we found an empty slot or we need to enlarge.
+   * The rotations of the rebalance only move the shorter subtree down, so they fit in the
+   * levels that the tree already uses. */
+  if (__reserve_level(me, __depth(i)))
+    return -1;
   n = &me->nodes[i];
   n->key = k;
   n->val = v;
+  n->height = 1;
   me->count += 1;
   return i;
 }
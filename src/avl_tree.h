@@ -8,11 +8,22 @@
 #ifndef AVL_TREE_H
 #define AVL_TREE_H
 
+#include <stddef.h>
+
 typedef struct {
   void* key;
   void* val;
+  unsigned char height; /* height of the subtree rooted at this node (1 for a leaf) */
 } node_t;
 
+/* Source of the memory of the tree. allocate returns uninitialized memory (like malloc) and
+ * release receives the size that was requested. */
+typedef struct {
+  void *(*allocate)(size_t size, void *ctx);
+  void (*release)(void *ptr, size_t size, void *ctx);
+  void *ctx;
+} avltree_allocator_t;
+
 typedef struct {
   /* size of array */
   int size;
@@ -24,7 +35,15 @@ typedef struct {
   void *shift_down_callback_user;
   void (*shift_up_callback)(int new_root, int last_root, void *user);
   void *shift_up_callback_user;
+  int (*update_callback)(int idx, void *user);
+  void *update_callback_user;
   node_t *nodes;
+  avltree_allocator_t allocator;
+#ifdef INTERVAL_TREE_STATS
+  unsigned long rotations;     /* Performed by the rebalance */
+  unsigned long enlargements;  /* Reallocations of nodes */
+  unsigned long bytes_copied;  /* By the reallocations */
+#endif
 } avltree_t;
 
 typedef struct {
@@ -33,6 +52,23 @@ typedef struct {
 
 avltree_t* avltree_new(int initial_size, long (*cmp)(const void *e1, const void *e2));
 
+/**
+ * @brief avltree_new that takes the memory of the tree from an allocator.
+ *
+ * @param allocator Copied into the tree. NULL uses malloc and free.
+ * @return NULL if the tree could not be allocated.
+ */
+avltree_t* avltree_new_with_allocator(int initial_size, long (*cmp)(const void *e1, const void *e2),
+                                      const avltree_allocator_t *allocator);
+
+/**
+ * @brief Grow the array of the tree to at least size positions, so that no reallocation
+ * happens while the tree fits in them.
+ *
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+int avltree_reserve(avltree_t* me, int size);
+
 void avltree_free(avltree_t* me);
 
 
@@ -46,26 +82,64 @@ int avltree_height(avltree_t* me);
 
 void avltree_empty(avltree_t* me);
 
-//Return the position where the node was inserted
+//Return the position where the node was inserted, -1 if the array could not grow (nothing is inserted)
 int avltree_insert(avltree_t* me, void* k, void* v);
 
 void* avltree_get(avltree_t* me, const void* k);
 
+/**
+ * @brief Replace the content of the tree by a perfectly balanced tree built in O(n).
+ * No rotation (and therefore no shift callback) is performed.
+ *
+ * @param me An AVL tree that has been previously allocated.
+ * @param keys The keys to store, already sorted in the order that an in-order traversal
+ * would return them (cmp(keys[i], keys[i+1]) > 0). Duplicates are not allowed.
+ * @param vals The values associated to each key. It can be NULL.
+ * @param n Number of elements in keys and vals.
+ * @param slots If not NULL, slots[i] receives the position of the array where keys[i] was stored.
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+int avltree_build(avltree_t* me, void **keys, void **vals, int n, int *slots);
+
+/**
+ * @brief avltree_build that lays out the subtrees of the top levels in different threads.
+ *
+ * @param me An AVL tree that has been previously allocated.
+ * @param keys See avltree_build.
+ * @param vals See avltree_build.
+ * @param n Number of elements in keys and vals.
+ * @param slots See avltree_build.
+ * @param nthreads Maximum number of threads, including the caller.
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+int avltree_build_parallel(avltree_t* me, void **keys, void **vals, int n, int *slots, int nthreads);
+
+/**
+ * @brief Position of the array where a key is stored.
+ *
+ * @param me An AVL tree that has been previously allocated.
+ * @param k The key to search.
+ * @return The position of the node, -1 if the key is not in the tree.
+ */
+int avltree_get_idx(avltree_t* me, const void* k);
+
 void* avltree_get_from_idx(avltree_t* me, int idx);
 
 /**
  * Rotate on X:
  * Y = X's parent
  * Step A: Y becomes left child of X
- * Step B: X's left child's becomes Y's right child */
-void avltree_rotate_left(avltree_t* me, int idx);
+ * Step B: X's left child's becomes Y's right child
+ * Returns -1 (and does nothing) if the subtree that goes down does not fit in the array. */
+int avltree_rotate_left(avltree_t* me, int idx);
 
 /**
  * Rotate on X:
  * Y = X's left child
  * Step A: X becomes right child of X's left child
- * Step B: X's left child's right child becomes X's left child */
-void avltree_rotate_right(avltree_t* me, int idx);
+ * Step B: X's left child's right child becomes X's left child
+ * Returns -1 (and does nothing) if the subtree that goes down does not fit in the array. */
+int avltree_rotate_right(avltree_t* me, int idx);
 
 
 /**
@@ -112,9 +186,22 @@ void set_shift_up_callback(avltree_t* me, void (*shift_up_callback)(int idx, int
  */
 void set_shift_down_callback(avltree_t* me, void (*shift_up_callback)(int idx, int towards, void *user), void *user);
 
+/**
+ * @brief Set the callback function that will be invoked every time that the children of a node
+ * change (after a rotation, and for every ancestor of an inserted or removed node) so that
+ * augmented data can be recomputed from the children. It is called bottom-up.
+ *
+ * @param me An AVL tree that has been previously allocated.
+ * @param update_callback The pointer to the function that will receive the position of the node and
+ * a user pointer. It must return a value different from 0 if the augmented data of the node changed.
+ * Once neither the height nor the augmented data of a node change the walk towards the root stops.
+ * @param user The pointer that will be passed as a second argument to the callback function
+ */
+void set_update_callback(avltree_t* me, int (*update_callback)(int idx, void *user), void *user);
+
 /**
  * @brief This function forces a rebalance of the tree. It must be invoked each time that a node is inserted
- * and  avltree_insert return differs from 0.
+ * and  avltree_insert return differs from 0. Heights are cached in every node, so the cost is O(log n).
  *
  * @param me An AVL tree that has been previously allocated.
  * @param idx The returned value by avltree_insert
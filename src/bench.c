@@ -0,0 +1,649 @@
+/**
+ * @file bench.c
+ * Benchmark suite of the interval tree: insertion, bulk build, lookups and removal over
+ * synthetic workloads or a trace of keys.
+ *
+ * For every workload and operation it reports the throughput, the p50/p99/p999 latency
+ * (measured in a second pass with a timestamp per operation, the overhead of the clock is
+ * discounted), the memory per stored range and, if perf_event_open is available, the cache
+ * and branch misses per operation. CSV and JSON outputs are meant to be diffed between versions.
+ *
+ * Usage: bench [-n ranges] [-q queries] [-w workload[,workload...]] [-t trace] [-f text|csv|json] [-s seed]
+ *   Workloads: ipv4 (random prefixes from /8 to /32), nested (nested and overlapping ranges),
+ *   sequential (consecutive ranges, as in example_it), skewed (the ranges of ipv4, but 90% of
+ *   the lookups go to a few thousand hot addresses) and trace (the keys of the file given
+ *   with -t, one per line in decimal, hexadecimal or dotted IPv4 notation, looked up in the
+ *   ranges of the ipv4 workload).
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "interval_tree.h"
+#include "interval_tree_cache.h"
+
+#define INT_TO_POINTER(i) (void *)((uint64_t)(i))
+#define MULTIPLE_QUERY_CAPACITY 256
+#define OVERLAP_WIDTH 255
+#define HOT_KEYS 4096
+#define CACHE_ENTRIES 16384
+
+enum { FORMAT_TEXT, FORMAT_CSV, FORMAT_JSON };
+
+struct workload {
+  const char *name;
+  range_t *ranges;
+  int nranges;
+  void **values;
+  interval_key_t *keys;
+  int nkeys;
+};
+
+struct bench_ctx {
+  struct workload *w;
+  interval_tree_t *tree;
+  interval_tree_cache_t *cache;
+  void *buf[MULTIPLE_QUERY_CAPACITY];
+  interval_tree_iterator_t it;
+  uint64_t sink;             /* Keeps the compiler from discarding the lookups */
+};
+
+struct phase {
+  const char *name;
+  int per_key;               /* One operation per key (otherwise, one per range) */
+  int prebuilt;              /* The tree is built before measuring */
+  int reserve;               /* The empty tree is sized for every range with interval_tree_reserve */
+  void (*op)(struct bench_ctx *c, int i);
+};
+
+struct counters {
+  int fd;                    /* Group leader, -1 if perf_event_open is not available */
+  int fd_branch;
+};
+
+struct result {
+  double seconds;
+  double p50, p99, p999;     /* Nanoseconds */
+  double cache_misses;       /* Per operation, negative if not available */
+  double branch_misses;
+  double bytes_per_range;
+};
+
+static uint64_t rng_state;
+
+/* xorshift64*: the keys of the workloads need more than the 31 bits of rand() */
+static uint64_t __rand64()
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Workloads
+ */
+
+static void __random_keys(struct workload *w, int nkeys, uint64_t span)
+{
+  int i;
+
+  w->nkeys = nkeys;
+  w->keys = malloc(nkeys * sizeof(interval_key_t));
+  for (i = 0; i < nkeys; i++) {
+    w->keys[i] = __rand64() % span;
+  }
+}
+
+/* Random IPv4 prefixes, most of them between /16 and /24 as in a routing table */
+static void __workload_ipv4(struct workload *w, int n, int nkeys)
+{
+  int i, len;
+  uint64_t base;
+
+  w->ranges = malloc(n * sizeof(range_t));
+  for (i = 0; i < n; i++) {
+    switch (__rand64() % 8) {
+    case 0:  len = 8 + __rand64() % 8;   break;
+    case 1:  len = 25 + __rand64() % 8;  break;
+    default: len = 16 + __rand64() % 9;  break;
+    }
+    base = (__rand64() & 0xffffffffULL) & ~((1ULL << (32 - len)) - 1);
+    w->ranges[i].inf = base;
+    w->ranges[i].sup = base + (1ULL << (32 - len)) - 1;
+  }
+  w->nranges = n;
+  __random_keys(w, nkeys, 1ULL << 32);
+}
+
+/* Ranges of any width from 1 to 2^21 around random centers: deeply nested and overlapping */
+static void __workload_nested(struct workload *w, int n, int nkeys)
+{
+  int i;
+  uint64_t center, half;
+
+  w->ranges = malloc(n * sizeof(range_t));
+  for (i = 0; i < n; i++) {
+    center = (1 << 20) + __rand64() % (1 << 30);
+    half = (1ULL << (__rand64() % 21)) - 1;
+    w->ranges[i].inf = center - half;
+    w->ranges[i].sup = center + half;
+  }
+  w->nranges = n;
+  __random_keys(w, nkeys, (1ULL << 30) + (1 << 21));
+}
+
+/* The ranges of the ipv4 workload, but most of the keys are drawn from a small hot set */
+static void __workload_skewed(struct workload *w, int n, int nkeys)
+{
+  interval_key_t hot[HOT_KEYS];
+  int i;
+
+  __workload_ipv4(w, n, nkeys);
+  for (i = 0; i < HOT_KEYS; i++) {
+    hot[i] = __rand64() & 0xffffffffULL;
+  }
+  for (i = 0; i < nkeys; i++) {
+    if (__rand64() % 10)
+      w->keys[i] = hot[__rand64() % HOT_KEYS];
+  }
+}
+
+/* Consecutive ranges of 20 integers inserted in order, like example_it */
+static void __workload_sequential(struct workload *w, int n, int nkeys)
+{
+  int i;
+
+  w->ranges = malloc(n * sizeof(range_t));
+  for (i = 0; i < n; i++) {
+    w->ranges[i].inf = (interval_key_t) i * 20;
+    w->ranges[i].sup = (interval_key_t) i * 20 + 19;
+  }
+  w->nranges = n;
+  __random_keys(w, nkeys, (uint64_t) n * 20 + 20);
+}
+
+static int __parse_key(const char *line, interval_key_t *k)
+{
+  unsigned int a, b, c, d;
+  char *end;
+
+  if (sscanf(line, "%u.%u.%u.%u", &a, &b, &c, &d) == 4) {
+    *k = ((uint64_t) a << 24) | (b << 16) | (c << 8) | d;
+    return 0;
+  }
+  *k = strtoull(line, &end, 0);
+  return end == line ? -1 : 0;
+}
+
+/* The keys of a trace file looked up in the ranges of the ipv4 workload */
+static int __workload_trace(struct workload *w, int n, const char *path)
+{
+  char line[128];
+  FILE *f;
+  int size = 1024;
+
+  f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+  __workload_ipv4(w, n, 0);
+  free(w->keys);
+  w->keys = malloc(size * sizeof(interval_key_t));
+  w->nkeys = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (w->nkeys == size) {
+      size *= 2;
+      w->keys = realloc(w->keys, size * sizeof(interval_key_t));
+    }
+    if (!__parse_key(line, &w->keys[w->nkeys]))
+      w->nkeys++;
+  }
+  fclose(f);
+  return 0;
+}
+
+/*
+ * Operations
+ */
+
+static void __op_insert(struct bench_ctx *c, int i)
+{
+  interval_tree_insert(c->tree, &c->w->ranges[i], c->w->values[i]);
+}
+
+static void __op_query(struct bench_ctx *c, int i)
+{
+  c->sink += (uintptr_t) interval_tree_query(c->tree, c->w->keys[i]);
+}
+
+static void __op_cached_query(struct bench_ctx *c, int i)
+{
+  c->sink += (uintptr_t) interval_tree_cache_query(c->cache, c->w->keys[i]);
+}
+
+static void __op_multiple_query(struct bench_ctx *c, int i)
+{
+  c->sink += interval_tree_multiple_query_r(c->tree, c->w->keys[i], c->buf, MULTIPLE_QUERY_CAPACITY);
+}
+
+static void __op_overlap(struct bench_ctx *c, int i)
+{
+  range_t r;
+
+  r.inf = c->w->keys[i];
+  r.sup = c->w->keys[i] + OVERLAP_WIDTH;
+  c->sink += interval_tree_overlap_any(c->tree, &r, NULL, NULL);
+}
+
+static void __op_narrowest(struct bench_ctx *c, int i)
+{
+  c->sink += interval_tree_narrowest_query(c->tree, c->w->keys[i], NULL, NULL);
+}
+
+static void __op_count(struct bench_ctx *c, int i)
+{
+  c->sink += interval_tree_count(c->tree, c->w->keys[i]);
+}
+
+/* One step of an in-order walk over the whole tree per range */
+static void __op_iterate(struct bench_ctx *c, int i)
+{
+  range_t r;
+
+  if (!i)
+    interval_tree_iterator_init(c->tree, &c->it);
+  c->sink += interval_tree_iterator_next(&c->it, &r, NULL);
+}
+
+static void __op_remove(struct bench_ctx *c, int i)
+{
+  c->sink += interval_tree_remove(c->tree, &c->w->ranges[i]);
+}
+
+static const struct phase phases[] = {
+  { "insert",          0, 0, 0, __op_insert },
+  { "reserved_insert", 0, 0, 1, __op_insert },
+  { "build",           0, 0, 0, NULL },
+  { "query",           1, 1, 0, __op_query },
+  { "cached_query",    1, 1, 0, __op_cached_query },
+  { "multiple_query",  1, 1, 0, __op_multiple_query },
+  { "overlap_any",     1, 1, 0, __op_overlap },
+  { "narrowest",       1, 1, 0, __op_narrowest },
+  { "count",           1, 1, 0, __op_count },
+  { "iterate",         0, 1, 0, __op_iterate },
+  { "remove",          0, 1, 0, __op_remove },
+};
+
+/*
+ * Hardware counters
+ */
+
+#ifdef __linux__
+static int __perf_open(uint64_t config, int group)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.disabled = group < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+static void __counters_open(struct counters *pc)
+{
+  pc->fd = pc->fd_branch = -1;
+#ifdef __linux__
+  pc->fd = __perf_open(PERF_COUNT_HW_CACHE_MISSES, -1);
+  if (pc->fd < 0)
+    return;
+  pc->fd_branch = __perf_open(PERF_COUNT_HW_BRANCH_MISSES, pc->fd);
+  if (pc->fd_branch < 0) {
+    close(pc->fd);
+    pc->fd = -1;
+  }
+#endif
+}
+
+static void __counters_start(struct counters *pc)
+{
+#ifdef __linux__
+  if (pc->fd >= 0) {
+    ioctl(pc->fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#else
+  (void) pc;
+#endif
+}
+
+static void __counters_stop(struct counters *pc, uint64_t ops, struct result *res)
+{
+  res->cache_misses = res->branch_misses = -1;
+#ifdef __linux__
+  if (pc->fd >= 0) {
+    uint64_t values[3]; /* Number of counters and their values */
+
+    ioctl(pc->fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (read(pc->fd, values, sizeof(values)) == sizeof(values) && ops) {
+      res->cache_misses = (double) values[1] / ops;
+      res->branch_misses = (double) values[2] / ops;
+    }
+  }
+#else
+  (void) pc;
+  (void) ops;
+#endif
+}
+
+/*
+ * Measurement
+ */
+
+static int cmp_u32(const void *e1, const void *e2)
+{
+  uint32_t a = *(const uint32_t *)e1, b = *(const uint32_t *)e2;
+
+  return a < b ? -1 : a > b;
+}
+
+/* Median cost of reading the clock twice, discounted from every latency sample */
+static uint32_t __timer_overhead()
+{
+  uint32_t samples[1001];
+  uint64_t t;
+  int i;
+
+  for (i = 0; i < 1001; i++) {
+    t = now_ns();
+    samples[i] = now_ns() - t;
+  }
+  qsort(samples, 1001, sizeof(uint32_t), cmp_u32);
+  return samples[500];
+}
+
+static void __prepare(struct bench_ctx *c, const struct phase *p)
+{
+  interval_tree_free(c->tree);
+  if (p->prebuilt)
+    c->tree = interval_tree_build(c->w->ranges, c->w->values, c->w->nranges);
+  else
+    c->tree = interval_tree_new(16);
+  if (p->reserve)
+    interval_tree_reserve(c->tree, c->w->nranges);
+  // Every pass starts with an empty cache
+  interval_tree_cache_free(c->cache);
+  c->cache = p->op == __op_cached_query ? interval_tree_cache_new(c->tree, CACHE_ENTRIES) : NULL;
+}
+
+static int __run_phase(struct bench_ctx *c, const struct phase *p, struct counters *pc,
+                       uint32_t *lat, uint32_t overhead, struct result *res)
+{
+  int i, ops = p->per_key ? c->w->nkeys : c->w->nranges;
+  uint64_t t0;
+  double t;
+
+  memset(res, 0, sizeof(*res));
+  if (!ops)
+    return 0;
+
+  if (!p->op) {
+    /* Bulk build: a single operation, only its throughput is meaningful */
+    interval_tree_free(c->tree);
+    __counters_start(pc);
+    t = now();
+    c->tree = interval_tree_build(c->w->ranges, c->w->values, c->w->nranges);
+    res->seconds = now() - t;
+    __counters_stop(pc, ops, res);
+    res->p50 = res->p99 = res->p999 = -1;
+    res->bytes_per_range = (double) interval_tree_memory(c->tree) / c->w->nranges;
+    return ops;
+  }
+
+  /* First pass: throughput and counters */
+  __prepare(c, p);
+  __counters_start(pc);
+  t = now();
+  for (i = 0; i < ops; i++) {
+    p->op(c, i);
+  }
+  res->seconds = now() - t;
+  __counters_stop(pc, ops, res);
+  res->bytes_per_range = (double) interval_tree_memory(c->tree) / c->w->nranges;
+
+  /* Second pass: latency of every operation */
+  __prepare(c, p);
+  for (i = 0; i < ops; i++) {
+    t0 = now_ns();
+    p->op(c, i);
+    t0 = now_ns() - t0;
+    lat[i] = t0 > overhead ? t0 - overhead : 0;
+  }
+  qsort(lat, ops, sizeof(uint32_t), cmp_u32);
+  res->p50 = lat[(int) (ops * 0.5)];
+  res->p99 = lat[(int) (ops * 0.99)];
+  res->p999 = lat[(int) (ops * 0.999)];
+  return ops;
+}
+
+/*
+ * Output
+ */
+
+static void __print_header(int format)
+{
+  switch (format) {
+  case FORMAT_TEXT:
+    printf("%-10s %-15s %9s %9s %12s %8s %8s %8s %9s %10s %10s\n", "workload", "operation", "ranges",
+           "ops", "ops/s", "p50(ns)", "p99(ns)", "p999(ns)", "bytes/rng", "cmiss/op", "bmiss/op");
+    break;
+  case FORMAT_CSV:
+    printf("workload,operation,ranges,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,"
+           "bytes_per_range,cache_misses_per_op,branch_misses_per_op\n");
+    break;
+  case FORMAT_JSON:
+    printf("[");
+    break;
+  }
+}
+
+/* Values that could not be measured are negative: empty in CSV, null in JSON, - in text */
+static void __print_value(int format, const char *fmt, double v)
+{
+  if (v >= 0)
+    printf(fmt, v);
+  else if (format == FORMAT_JSON)
+    printf("null");
+  else if (format == FORMAT_TEXT)
+    printf("%s", "-");
+}
+
+static void __print_result(int format, int first, struct workload *w, const struct phase *p,
+                           int ops, struct result *res)
+{
+  double ops_per_sec = res->seconds > 0 ? ops / res->seconds : -1;
+
+  switch (format) {
+  case FORMAT_TEXT:
+    printf("%-10s %-15s %9d %9d %12.0f ", w->name, p->name, w->nranges, ops, ops_per_sec);
+    if (res->p50 >= 0)
+      printf("%8.0f %8.0f %8.0f ", res->p50, res->p99, res->p999);
+    else
+      printf("%8s %8s %8s ", "-", "-", "-");
+    printf("%9.1f ", res->bytes_per_range);
+    if (res->cache_misses >= 0)
+      printf("%10.2f %10.2f\n", res->cache_misses, res->branch_misses);
+    else
+      printf("%10s %10s\n", "-", "-");
+    break;
+  case FORMAT_CSV:
+    printf("%s,%s,%d,%d,%.6f,%.0f,", w->name, p->name, w->nranges, ops, res->seconds, ops_per_sec);
+    __print_value(format, "%.0f", res->p50);
+    printf(",");
+    __print_value(format, "%.0f", res->p99);
+    printf(",");
+    __print_value(format, "%.0f", res->p999);
+    printf(",%.1f,", res->bytes_per_range);
+    __print_value(format, "%.3f", res->cache_misses);
+    printf(",");
+    __print_value(format, "%.3f", res->branch_misses);
+    printf("\n");
+    break;
+  case FORMAT_JSON:
+    printf("%s\n  {\"workload\": \"%s\", \"operation\": \"%s\", \"ranges\": %d, \"ops\": %d, "
+           "\"seconds\": %.6f, \"ops_per_sec\": %.0f, \"p50_ns\": ", first ? "" : ",",
+           w->name, p->name, w->nranges, ops, res->seconds, ops_per_sec);
+    __print_value(format, "%.0f", res->p50);
+    printf(", \"p99_ns\": ");
+    __print_value(format, "%.0f", res->p99);
+    printf(", \"p999_ns\": ");
+    __print_value(format, "%.0f", res->p999);
+    printf(", \"bytes_per_range\": %.1f, \"cache_misses_per_op\": ", res->bytes_per_range);
+    __print_value(format, "%.3f", res->cache_misses);
+    printf(", \"branch_misses_per_op\": ");
+    __print_value(format, "%.3f", res->branch_misses);
+    printf("}");
+    break;
+  }
+}
+
+static void __usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-n ranges] [-q queries] [-w workload[,workload...]] [-t trace]"
+          " [-f text|csv|json] [-s seed]\n"
+          "  workloads: ipv4, nested, sequential, skewed, trace (requires -t)."
+          " Default: ipv4,nested,sequential,skewed\n",
+          prog);
+}
+
+int main(int argc, char **argv)
+{
+  int nranges = 1000000, nqueries = 1000000, format = FORMAT_TEXT, first = 1;
+  const char *workloads = "ipv4,nested,sequential,skewed", *trace = NULL;
+  char *list, *name, *saveptr;
+  struct counters pc;
+  uint32_t overhead, *lat;
+  int opt, ops, i, maxops;
+
+  rng_state = 0x69;
+  while ((opt = getopt(argc, argv, "n:q:w:t:f:s:h")) != -1) {
+    switch (opt) {
+    case 'n': nranges = atoi(optarg); break;
+    case 'q': nqueries = atoi(optarg); break;
+    case 'w': workloads = optarg; break;
+    case 't': trace = optarg; break;
+    case 's': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+    case 'f':
+      if (!strcmp(optarg, "csv")) format = FORMAT_CSV;
+      else if (!strcmp(optarg, "json")) format = FORMAT_JSON;
+      else if (!strcmp(optarg, "text")) format = FORMAT_TEXT;
+      else { __usage(argv[0]); return 1; }
+      break;
+    default:
+      __usage(argv[0]);
+      return 1;
+    }
+  }
+  if (nranges <= 0 || nqueries < 0) {
+    __usage(argv[0]);
+    return 1;
+  }
+
+  __counters_open(&pc);
+  overhead = __timer_overhead();
+  if (format == FORMAT_TEXT && pc.fd < 0)
+    printf("perf_event_open is not available: no hardware counters\n");
+  __print_header(format);
+
+  list = strdup(workloads);
+  for (name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+    struct workload w;
+    struct bench_ctx c;
+
+    memset(&w, 0, sizeof(w));
+    w.name = name;
+    if (!strcmp(name, "ipv4")) {
+      __workload_ipv4(&w, nranges, nqueries);
+    } else if (!strcmp(name, "nested")) {
+      __workload_nested(&w, nranges, nqueries);
+    } else if (!strcmp(name, "sequential")) {
+      __workload_sequential(&w, nranges, nqueries);
+    } else if (!strcmp(name, "skewed")) {
+      __workload_skewed(&w, nranges, nqueries);
+    } else if (!strcmp(name, "trace") && trace) {
+      if (__workload_trace(&w, nranges, trace))
+        return 1;
+    } else {
+      __usage(argv[0]);
+      return 1;
+    }
+
+    w.values = malloc(w.nranges * sizeof(void *));
+    for (i = 0; i < w.nranges; i++) {
+      w.values[i] = INT_TO_POINTER(i + 1);
+    }
+    maxops = w.nkeys > w.nranges ? w.nkeys : w.nranges;
+    lat = malloc(maxops * sizeof(uint32_t));
+    memset(&c, 0, sizeof(c));
+    c.w = &w;
+    for (i = 0; i < (int) (sizeof(phases) / sizeof(phases[0])); i++) {
+      struct result res;
+
+      ops = __run_phase(&c, &phases[i], &pc, lat, overhead, &res);
+      if (!ops)
+        continue;
+      __print_result(format, first, &w, &phases[i], ops, &res);
+      first = 0;
+      fflush(stdout);
+    }
+    interval_tree_free(c.tree);
+    interval_tree_cache_free(c.cache);
+    free(lat);
+    free(w.ranges);
+    free(w.values);
+    free(w.keys);
+  }
+  if (format == FORMAT_JSON)
+    printf("\n]\n");
+
+  free(list);
+  if (pc.fd >= 0) {
+    close(pc.fd_branch);
+    close(pc.fd);
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file bench_batch.c
+ * Compares the batched lookups (interval_tree_query_batch) and the frozen tree
+ * (interval_tree_frozen_query) with a loop of scalar lookups.
+ *
+ * Usage: bench_batch [ranges] [queries] [burst]
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "interval_tree.h"
+#include "interval_tree_frozen.h"
+
+#define INT_TO_POINTER(i) (void *)((uint64_t)(i))
+#define KEY_SPACE (1 << 30)
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  int nranges = argc > 1 ? atoi(argv[1]) : 1000000;
+  int nqueries = argc > 2 ? atoi(argv[2]) : 4000000;
+  int burst = argc > 3 ? atoi(argv[3]) : 64;
+  range_t *ranges;
+  void **values, **out_scalar, **out_batch, **out_frozen;
+  interval_key_t *keys;
+  interval_tree_t *intervalt;
+  interval_tree_frozen_t *frozen;
+  double t, t_scalar, t_batch, t_frozen;
+  int i, j, mismatches = 0;
+
+  ranges = malloc(nranges * sizeof(range_t));
+  values = malloc(nranges * sizeof(void *));
+  keys = malloc(nqueries * sizeof(interval_key_t));
+  out_scalar = malloc(nqueries * sizeof(void *));
+  out_batch = malloc(nqueries * sizeof(void *));
+  out_frozen = malloc(nqueries * sizeof(void *));
+  if (!ranges || !values || !keys || !out_scalar || !out_batch || !out_frozen) {
+    fprintf(stderr, "Not enough memory\n");
+    return 1;
+  }
+
+  srand(0x69);
+  for (i = 0; i < nranges; i++) {
+    ranges[i].inf = rand() % KEY_SPACE;
+    ranges[i].sup = ranges[i].inf + rand() % 4096;
+    values[i] = INT_TO_POINTER(i + 1);
+  }
+  for (i = 0; i < nqueries; i++) {
+    keys[i] = rand() % KEY_SPACE;
+  }
+
+  intervalt = interval_tree_build(ranges, values, nranges);
+  if (!intervalt) {
+    fprintf(stderr, "The tree could not be built\n");
+    return 1;
+  }
+  frozen = interval_tree_freeze(intervalt);
+  if (!frozen) {
+    fprintf(stderr, "The tree could not be frozen\n");
+    return 1;
+  }
+
+  t = now();
+  for (i = 0; i < nqueries; i++) {
+    out_scalar[i] = interval_tree_query(intervalt, keys[i]);
+  }
+  t_scalar = now() - t;
+
+  t = now();
+  for (i = 0; i < nqueries; i += burst) {
+    j = nqueries - i < burst ? nqueries - i : burst;
+    interval_tree_query_batch(intervalt, &keys[i], j, &out_batch[i]);
+  }
+  t_batch = now() - t;
+
+  t = now();
+  for (i = 0; i < nqueries; i++) {
+    out_frozen[i] = interval_tree_frozen_query(frozen, keys[i]);
+  }
+  t_frozen = now() - t;
+
+  for (i = 0; i < nqueries; i++) {
+    mismatches += out_scalar[i] != out_batch[i];
+    mismatches += out_scalar[i] != out_frozen[i];
+  }
+
+  printf("%d ranges, %d queries, bursts of %d\n", nranges, nqueries, burst);
+  printf("scalar: %8.3f s %10.0f queries/s\n", t_scalar, nqueries / t_scalar);
+  printf("batch:  %8.3f s %10.0f queries/s (x%.2f)\n", t_batch, nqueries / t_batch, t_scalar / t_batch);
+  printf("frozen: %8.3f s %10.0f queries/s (x%.2f, %d segments)\n", t_frozen, nqueries / t_frozen,
+         t_scalar / t_frozen, interval_tree_frozen_segments(frozen));
+  if (mismatches)
+    printf("ERROR: %d results differ\n", mismatches);
+
+  interval_tree_frozen_free(frozen);
+  interval_tree_free(intervalt);
+  free(ranges);
+  free(values);
+  free(keys);
+  free(out_scalar);
+  free(out_batch);
+  free(out_frozen);
+  return mismatches != 0;
+}
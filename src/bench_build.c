@@ -0,0 +1,80 @@
+/**
+ * @file bench_build.c
+ * Time of interval_tree_build_parallel with 1..N threads over a random (unsorted) set of ranges.
+ *
+ * Usage: bench_build [ranges] [max_threads] [repetitions]
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interval_tree.h"
+
+#define INT_TO_POINTER(i) (void *)((uint64_t)(i))
+#define KEY_SPACE (1 << 30)
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  int nranges = argc > 1 ? atoi(argv[1]) : 4000000;
+  int max_threads = argc > 2 ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  int repetitions = argc > 3 ? atoi(argv[3]) : 3;
+  interval_tree_t *tree;
+  range_t *ranges;
+  void **values;
+  double t, best, base = 0;
+  int i, nthreads, rep;
+
+  ranges = malloc(nranges * sizeof(range_t));
+  values = malloc(nranges * sizeof(void *));
+  if (!ranges || !values) {
+    fprintf(stderr, "Not enough memory\n");
+    return 1;
+  }
+
+  srand(0x69);
+  for (i = 0; i < nranges; i++) {
+    ranges[i].inf = ((interval_key_t) rand() << 16 ^ rand()) % KEY_SPACE;
+    ranges[i].sup = ranges[i].inf + rand() % 4096;
+    values[i] = INT_TO_POINTER(i + 1);
+  }
+
+  printf("%d ranges, best of %d builds\n", nranges, repetitions);
+  printf("threads   seconds   Mranges/s  speedup\n");
+  for (nthreads = 1; nthreads <= max_threads; nthreads = nthreads < max_threads && nthreads * 2 > max_threads ? max_threads : nthreads * 2) {
+    best = 0;
+    for (rep = 0; rep < repetitions; rep++) {
+      t = now();
+      tree = interval_tree_build_parallel(ranges, values, nranges, nthreads);
+      t = now() - t;
+      if (!tree) {
+        fprintf(stderr, "The tree could not be built\n");
+        return 1;
+      }
+      interval_tree_free(tree);
+      if (!rep || t < best)
+        best = t;
+    }
+    if (nthreads == 1)
+      base = best;
+    printf("%7d %9.3f %11.2f %8.2f\n", nthreads, best, nranges / best / 1e6, base / best);
+    if (nthreads == max_threads)
+      break;
+  }
+
+  free(ranges);
+  free(values);
+  return 0;
+}
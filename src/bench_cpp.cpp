@@ -0,0 +1,97 @@
+/**
+ * @file bench_cpp.cpp
+ * Compares the C++ interval tree (interval_tree.hpp), whose comparisons are inlined and whose
+ * values are stored by type, with the C library, which compares through a function pointer
+ * and boxes the values in a void *.
+ *
+ * Usage: bench_cpp [ranges] [queries]
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#include "interval_tree.h"
+#include "interval_tree.hpp"
+
+#define INT_TO_POINTER(i) (void *)((uint64_t)(i))
+#define POINTER_TO_INT(p) (unsigned int)((uint64_t)(p))
+#define KEY_SPACE (1 << 30)
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  int nranges = argc > 1 ? atoi(argv[1]) : 1000000;
+  int nqueries = argc > 2 ? atoi(argv[2]) : 4000000;
+  typedef interval_trees::interval_tree<interval_key_t, unsigned int> tree_t;
+  std::vector<range_t> ranges(nranges);
+  std::vector<interval_key_t> keys(nqueries);
+  std::vector<unsigned int> out_c(nqueries), out_cpp(nqueries);
+  interval_tree_t *intervalt;
+  tree_t tree;
+  double t, t_insert_c, t_insert_cpp, t_query_c, t_query_cpp;
+  int i, mismatches = 0;
+
+  srand(0x69);
+  for (i = 0; i < nranges; i++) {
+    ranges[i].inf = rand() % KEY_SPACE;
+    ranges[i].sup = ranges[i].inf + rand() % 4096;
+  }
+  for (i = 0; i < nqueries; i++) {
+    keys[i] = rand() % KEY_SPACE;
+  }
+
+  t = now();
+  intervalt = interval_tree_new(16);
+  for (i = 0; i < nranges; i++) {
+    interval_tree_insert(intervalt, &ranges[i], INT_TO_POINTER(i + 1));
+  }
+  t_insert_c = now() - t;
+
+  t = now();
+  for (i = 0; i < nranges; i++) {
+    tree.insert(ranges[i].inf, ranges[i].sup, i + 1);
+  }
+  t_insert_cpp = now() - t;
+
+  t = now();
+  for (i = 0; i < nqueries; i++) {
+    out_c[i] = POINTER_TO_INT(interval_tree_query(intervalt, keys[i]));
+  }
+  t_query_c = now() - t;
+
+  t = now();
+  for (i = 0; i < nqueries; i++) {
+    const unsigned int *v = tree.query(keys[i]);
+    out_cpp[i] = v ? *v : 0;
+  }
+  t_query_cpp = now() - t;
+
+  // Both trees may report a different range when several of them contain the key
+  for (i = 0; i < nqueries; i++) {
+    mismatches += !out_c[i] != !out_cpp[i];
+  }
+
+  printf("%d ranges, %d queries\n", nranges, nqueries);
+  printf("insert C:   %8.3f s %10.0f ranges/s\n", t_insert_c, nranges / t_insert_c);
+  printf("insert C++: %8.3f s %10.0f ranges/s (x%.2f)\n", t_insert_cpp, nranges / t_insert_cpp, t_insert_c / t_insert_cpp);
+  printf("query C:    %8.3f s %10.0f queries/s\n", t_query_c, nqueries / t_query_c);
+  printf("query C++:  %8.3f s %10.0f queries/s (x%.2f)\n", t_query_cpp, nqueries / t_query_cpp, t_query_c / t_query_cpp);
+  printf("memory: C %zu bytes, C++ %zu bytes\n", interval_tree_memory(intervalt), tree.memory());
+  if (mismatches)
+    printf("ERROR: %d results differ\n", mismatches);
+
+  interval_tree_free(intervalt);
+  return mismatches != 0;
+}
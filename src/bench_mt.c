@@ -0,0 +1,162 @@
+/**
+ * @file bench_mt.c
+ * Stress benchmark of interval_tree_mt: read throughput with 1..N reader threads while a
+ * writer keeps inserting ranges.
+ *
+ * Usage: bench_mt [ranges] [max_threads] [seconds] [writes_per_second]
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "interval_tree_mt.h"
+
+#define INT_TO_POINTER(i) (void *)((uint64_t)(i))
+#define KEY_SPACE (1 << 30)
+
+static atomic_int stop;
+
+struct reader_args {
+  interval_tree_mt_t *tree;
+  unsigned int seed;
+  uint64_t queries;
+  uint64_t hits;
+};
+
+struct writer_args {
+  interval_tree_mt_t *tree;
+  int writes_per_second;
+  uint64_t writes;
+};
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *reader(void *p)
+{
+  struct reader_args *args = p;
+  interval_tree_mt_reader_t *r;
+  uint64_t queries = 0, hits = 0;
+
+  r = interval_tree_mt_reader_new(args->tree);
+  while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+    hits += interval_tree_mt_query(r, rand_r(&args->seed) % KEY_SPACE) != NULL;
+    queries++;
+  }
+  interval_tree_mt_reader_free(r);
+  args->queries = queries;
+  args->hits = hits;
+  return NULL;
+}
+
+static void *writer(void *p)
+{
+  struct writer_args *args = p;
+  unsigned int seed = 0x70;
+  struct timespec pause;
+  range_t r;
+  double start = now();
+
+  pause.tv_sec = 0;
+  pause.tv_nsec = 1000000000L / args->writes_per_second;
+  while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+    r.inf = rand_r(&seed) % KEY_SPACE;
+    r.sup = r.inf + rand_r(&seed) % 4096;
+    interval_tree_mt_insert(args->tree, &r, INT_TO_POINTER(args->writes + 1));
+    args->writes++;
+    /* Keep the requested rate */
+    if (args->writes > (now() - start) * args->writes_per_second)
+      nanosleep(&pause, NULL);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  int nranges = argc > 1 ? atoi(argv[1]) : 1000000;
+  int max_threads = argc > 2 ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  double seconds = argc > 3 ? atof(argv[3]) : 1.0;
+  int writes_per_second = argc > 4 ? atoi(argv[4]) : 500;
+  struct reader_args *rargs;
+  struct writer_args wargs;
+  pthread_t *threads, wthread;
+  interval_tree_mt_t *tree;
+  range_t *ranges;
+  void **values;
+  double t, base = 0;
+  int i, nthreads;
+
+  ranges = malloc(nranges * sizeof(range_t));
+  values = malloc(nranges * sizeof(void *));
+  rargs = calloc(max_threads, sizeof(struct reader_args));
+  threads = calloc(max_threads, sizeof(pthread_t));
+  if (!ranges || !values || !rargs || !threads) {
+    fprintf(stderr, "Not enough memory\n");
+    return 1;
+  }
+
+  srand(0x69);
+  for (i = 0; i < nranges; i++) {
+    ranges[i].inf = rand() % KEY_SPACE;
+    ranges[i].sup = ranges[i].inf + rand() % 4096;
+    values[i] = INT_TO_POINTER(i + 1);
+  }
+  tree = interval_tree_mt_build(ranges, values, nranges);
+  if (!tree) {
+    fprintf(stderr, "The tree could not be built\n");
+    return 1;
+  }
+
+  printf("%d ranges, %d writes/s, %.1f s per step\n", nranges, writes_per_second, seconds);
+  printf("threads   reads/s        reads/s/thread  speedup  writes/s\n");
+  for (nthreads = 1; nthreads <= max_threads; nthreads++) {
+    uint64_t queries = 0;
+
+    atomic_store(&stop, 0);
+    wargs.tree = tree;
+    wargs.writes_per_second = writes_per_second;
+    wargs.writes = 0;
+    for (i = 0; i < nthreads; i++) {
+      rargs[i].tree = tree;
+      rargs[i].seed = i + 1;
+      pthread_create(&threads[i], NULL, reader, &rargs[i]);
+    }
+    if (writes_per_second > 0)
+      pthread_create(&wthread, NULL, writer, &wargs);
+
+    t = now();
+    usleep(seconds * 1e6);
+    atomic_store(&stop, 1);
+    for (i = 0; i < nthreads; i++) {
+      pthread_join(threads[i], NULL);
+      queries += rargs[i].queries;
+    }
+    if (writes_per_second > 0)
+      pthread_join(wthread, NULL);
+    t = now() - t;
+
+    if (nthreads == 1)
+      base = queries / t;
+    printf("%7d %12.0f %16.0f %9.2f %9.0f\n", nthreads, queries / t, queries / t / nthreads,
+           queries / t / base, wargs.writes / t);
+  }
+
+  interval_tree_mt_free(tree);
+  free(ranges);
+  free(values);
+  free(rargs);
+  free(threads);
+  return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file bench_sharded.c
+ * Insertion throughput of interval_tree_sharded with 1..N writer threads that spread their
+ * ranges over the whole key space, against a single tree protected by a global mutex.
+ *
+ * Usage: bench_sharded [ranges_per_thread] [max_threads] [shards]
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "interval_tree_sharded.h"
+
+#define INT_TO_POINTER(i) (void *)((uint64_t)(i))
+#define KEY_SPACE (1 << 30)
+
+struct writer_args {
+  interval_tree_sharded_t *sharded;   /**< The tree under test, or NULL for the global one */
+  int nranges;
+  unsigned int seed;
+  uint64_t hits;
+};
+
+static interval_tree_t *global_tree;
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Every insertion is followed by a lookup of a random key, as a classifier that learns ranges */
+static void *writer(void *p)
+{
+  struct writer_args *args = p;
+  range_t r;
+  interval_key_t k;
+  void *v;
+  int i;
+
+  for (i = 0; i < args->nranges; i++) {
+    r.inf = rand_r(&args->seed) % KEY_SPACE;
+    r.sup = r.inf + rand_r(&args->seed) % 4096;
+    k = rand_r(&args->seed) % KEY_SPACE;
+    if (args->sharded) {
+      interval_tree_sharded_insert(args->sharded, &r, INT_TO_POINTER(i + 1));
+      v = interval_tree_sharded_query(args->sharded, k);
+    } else {
+      pthread_mutex_lock(&global_lock);
+      interval_tree_insert(global_tree, &r, INT_TO_POINTER(i + 1));
+      v = interval_tree_query(global_tree, k);
+      pthread_mutex_unlock(&global_lock);
+    }
+    args->hits += v != NULL;
+  }
+  return NULL;
+}
+
+static double run(interval_tree_sharded_t *sharded, int nthreads, int nranges, struct writer_args *args, pthread_t *threads)
+{
+  double t;
+  int i;
+
+  t = now();
+  for (i = 0; i < nthreads; i++) {
+    args[i].sharded = sharded;
+    args[i].nranges = nranges;
+    args[i].seed = i + 1;
+    args[i].hits = 0;
+    pthread_create(&threads[i], NULL, writer, &args[i]);
+  }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  return (uint64_t) nthreads * nranges / (now() - t);
+}
+
+int main(int argc, char **argv)
+{
+  int nranges = argc > 1 ? atoi(argv[1]) : 200000;
+  int max_threads = argc > 2 ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  int nshards = argc > 3 ? atoi(argv[3]) : 64;
+  interval_tree_sharded_t *sharded;
+  struct writer_args *args;
+  pthread_t *threads;
+  double global, ops, base = 0;
+  int nthreads;
+
+  if (max_threads < 1)
+    max_threads = 1;
+  args = calloc(max_threads, sizeof(struct writer_args));
+  threads = calloc(max_threads, sizeof(pthread_t));
+  if (!args || !threads) {
+    fprintf(stderr, "Not enough memory\n");
+    return 1;
+  }
+
+  printf("%d insertions+lookups per thread, %d shards\n", nranges, nshards);
+  printf("threads   global ops/s   sharded ops/s  speedup  vs global\n");
+  for (nthreads = 1; nthreads <= max_threads; nthreads++) {
+    global_tree = interval_tree_new(nthreads * nranges);
+    sharded = interval_tree_sharded_new(nshards, 0, KEY_SPACE - 1);
+    if (!global_tree || !sharded) {
+      fprintf(stderr, "The trees could not be allocated\n");
+      return 1;
+    }
+
+    global = run(NULL, nthreads, nranges, args, threads);
+    ops = run(sharded, nthreads, nranges, args, threads);
+    if (nthreads == 1)
+      base = ops;
+    printf("%7d %14.0f %15.0f %8.2f %10.2f\n", nthreads, global, ops, ops / base, ops / global);
+
+    interval_tree_free(global_tree);
+    interval_tree_sharded_free(sharded);
+  }
+
+  free(args);
+  free(threads);
+  return 0;
+}
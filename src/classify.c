@@ -0,0 +1,462 @@
+/**
+ * @file classify.c
+ * Offline classification of a stream of binary keys (flow logs) through an interval tree.
+ *
+ * The keys are 32 or 64 bit integers in host byte order. A file is mapped with mmap; stdin
+ * (or a pipe) is read in large blocks. Every block is looked up with interval_tree_query_batch
+ * and the values of the matched ranges (0 if there is none) are written as a binary column of
+ * 32 or 64 bit integers, one per key and in the same order, with a single write per block.
+ *
+ * The work is pipelined: a reader thread loads blocks, N worker threads classify them and a
+ * writer thread emits them in order, so reading, lookups and writing overlap.
+ *
+ * Usage: classify (-r rules | -s snapshot) [-k 32|64] [-w 32|64] [-j threads] [-b keys_per_block]
+ *                 [-o output] [keys]
+ *   rules: text file with a range per line, "inf sup value" (decimal, hexadecimal or dotted IPv4).
+ *   snapshot: tree saved with interval_tree_save (see interval_tree_snapshot.h).
+ *   keys: binary file of keys (default: stdin). output: binary file of values (default: stdout).
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "interval_tree.h"
+#include "interval_tree_snapshot.h"
+
+#define INT_TO_POINTER(i) (void *)((uint64_t)(i))
+#define LOOKUP_BURST 1024 /**< Keys passed to interval_tree_query_batch at once */
+
+enum {
+  SLOT_EMPTY,     /* Ready to be filled by the reader */
+  SLOT_READ,      /* Keys loaded, waiting for a worker */
+  SLOT_BUSY,      /* Being classified */
+  SLOT_DONE       /* Values ready to be written */
+};
+
+struct slot {
+  int state;
+  uint64_t seq;              /* Position of the block in the stream */
+  const unsigned char *keys; /* Points to buf, or into the mapped file */
+  unsigned char *buf;        /* Keys read from a stream */
+  unsigned char *out;
+  size_t n;                  /* Keys in the block */
+};
+
+struct pipeline {
+  interval_tree_t *tree;
+  int key_bytes, value_bytes;
+  size_t block;              /* Keys per block */
+
+  int in_fd, out_fd;
+  const unsigned char *map;  /* Mapped input, NULL if it is a stream */
+  size_t map_keys;
+
+  struct slot *slots;
+  int nslots;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  uint64_t next_lookup;      /* Next block that a worker takes */
+  uint64_t nblocks;          /* Known once the reader finishes */
+  int eof;
+  int error;
+
+  uint64_t keys, hits;
+};
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int __parse_key(const char *s, char **end, interval_key_t *k)
+{
+  unsigned int a, b, c, d;
+  int len;
+
+  if (sscanf(s, " %u.%u.%u.%u%n", &a, &b, &c, &d, &len) == 4) {
+    *k = ((uint64_t) a << 24) | (b << 16) | (c << 8) | d;
+    *end = (char *) s + len;
+    return 0;
+  }
+  *k = strtoull(s, end, 0);
+  return *end == s ? -1 : 0;
+}
+
+/* Text file with "inf sup value" per line; empty lines and lines starting with # are skipped */
+static interval_tree_t *__load_rules(const char *path, int nthreads)
+{
+  interval_tree_t *tree;
+  range_t *ranges = NULL;
+  void **values = NULL;
+  int n = 0, size = 0, line = 0;
+  char buf[256], *p, *end;
+  interval_key_t v;
+  FILE *f;
+
+  f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return NULL;
+  }
+  while (fgets(buf, sizeof(buf), f)) {
+    line++;
+    for (p = buf; *p == ' ' || *p == '\t'; p++);
+    if (*p == '#' || *p == '\n' || !*p)
+      continue;
+    if (n == size) {
+      size = size ? size * 2 : 1024;
+      ranges = realloc(ranges, size * sizeof(range_t));
+      values = realloc(values, size * sizeof(void *));
+      if (!ranges || !values) {
+        fprintf(stderr, "Not enough memory\n");
+        exit(1);
+      }
+    }
+    if (__parse_key(p, &end, &ranges[n].inf) || __parse_key(end, &end, &ranges[n].sup) ||
+        __parse_key(end, &end, &v) || ranges[n].sup < ranges[n].inf) {
+      fprintf(stderr, "%s:%d: expected \"inf sup value\"\n", path, line);
+      exit(1);
+    }
+    values[n++] = INT_TO_POINTER(v);
+  }
+  fclose(f);
+
+  tree = interval_tree_build_parallel(ranges, values, n, nthreads);
+  free(ranges);
+  free(values);
+  return tree;
+}
+
+/* Read until the buffer is full or the stream ends */
+static ssize_t __read_full(int fd, unsigned char *buf, size_t len)
+{
+  size_t done = 0;
+  ssize_t r;
+
+  while (done < len) {
+    r = read(fd, buf + done, len - done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return -1;
+    if (!r)
+      break;
+    done += r;
+  }
+  return done;
+}
+
+static int __write_full(int fd, const unsigned char *buf, size_t len)
+{
+  ssize_t r;
+
+  while (len) {
+    r = write(fd, buf, len);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return -1;
+    buf += r;
+    len -= r;
+  }
+  return 0;
+}
+
+static void *reader(void *arg)
+{
+  struct pipeline *pl = arg;
+  struct slot *s;
+  uint64_t seq;
+  ssize_t r;
+  int stop;
+
+  for (seq = 0; ; seq++) {
+    s = &pl->slots[seq % pl->nslots];
+    pthread_mutex_lock(&pl->lock);
+    while (s->state != SLOT_EMPTY && !pl->error)
+      pthread_cond_wait(&pl->changed, &pl->lock);
+    stop = pl->error;
+    pthread_mutex_unlock(&pl->lock);
+    if (stop)
+      break;
+
+    if (pl->map) {
+      size_t first = seq * pl->block;
+
+      if (first >= pl->map_keys)
+        break;
+      s->keys = pl->map + first * pl->key_bytes;
+      s->n = pl->map_keys - first < pl->block ? pl->map_keys - first : pl->block;
+      // Start reading the next block from the disk while this one is classified
+      if (first + s->n < pl->map_keys)
+        madvise((void *) ((uintptr_t) (s->keys + s->n * pl->key_bytes) & ~(uintptr_t) 4095),
+                s->n * pl->key_bytes, MADV_WILLNEED);
+    } else {
+      r = __read_full(pl->in_fd, s->buf, pl->block * pl->key_bytes);
+      if (r < 0) {
+        perror("read");
+        pthread_mutex_lock(&pl->lock);
+        pl->error = 1;
+        pthread_cond_broadcast(&pl->changed);
+        pthread_mutex_unlock(&pl->lock);
+        break;
+      }
+      s->keys = s->buf;
+      s->n = r / pl->key_bytes;
+      // Only the last read of a stream can end in the middle of a key
+      if (r % pl->key_bytes)
+        fprintf(stderr, "Ignoring %zu trailing bytes of a partial key\n", (size_t) (r % pl->key_bytes));
+      if (!s->n)
+        break;
+    }
+
+    pthread_mutex_lock(&pl->lock);
+    s->seq = seq;
+    s->state = SLOT_READ;
+    pthread_cond_broadcast(&pl->changed);
+    pthread_mutex_unlock(&pl->lock);
+  }
+
+  pthread_mutex_lock(&pl->lock);
+  pl->nblocks = seq;
+  pl->eof = 1;
+  pthread_cond_broadcast(&pl->changed);
+  pthread_mutex_unlock(&pl->lock);
+  return NULL;
+}
+
+/* Classify the keys of a block in bursts of LOOKUP_BURST */
+static uint64_t __classify(struct pipeline *pl, struct slot *s)
+{
+  interval_key_t keys[LOOKUP_BURST];
+  void *values[LOOKUP_BURST];
+  uint64_t hits = 0;
+  size_t i, j, m;
+  uint32_t k32;
+  uint64_t k64, v;
+
+  for (i = 0; i < s->n; i += m) {
+    m = s->n - i < LOOKUP_BURST ? s->n - i : LOOKUP_BURST;
+    for (j = 0; j < m; j++) {
+      if (pl->key_bytes == 4) {
+        memcpy(&k32, s->keys + (i + j) * 4, 4);
+        keys[j] = k32;
+      } else {
+        memcpy(&k64, s->keys + (i + j) * 8, 8);
+        keys[j] = k64;
+      }
+    }
+    interval_tree_query_batch(pl->tree, keys, m, values);
+    for (j = 0; j < m; j++) {
+      v = (uint64_t) (uintptr_t) values[j];
+      hits += values[j] != NULL;
+      if (pl->value_bytes == 4) {
+        k32 = (uint32_t) v;
+        memcpy(s->out + (i + j) * 4, &k32, 4);
+      } else {
+        memcpy(s->out + (i + j) * 8, &v, 8);
+      }
+    }
+  }
+  return hits;
+}
+
+static void *worker(void *arg)
+{
+  struct pipeline *pl = arg;
+  struct slot *s;
+  uint64_t hits;
+
+  pthread_mutex_lock(&pl->lock);
+  for (;;) {
+    s = &pl->slots[pl->next_lookup % pl->nslots];
+    while (!pl->error && !(s->state == SLOT_READ && s->seq == pl->next_lookup) &&
+           !(pl->eof && pl->next_lookup >= pl->nblocks)) {
+      pthread_cond_wait(&pl->changed, &pl->lock);
+      s = &pl->slots[pl->next_lookup % pl->nslots];
+    }
+    if (pl->error || (pl->eof && pl->next_lookup >= pl->nblocks))
+      break;
+    s->state = SLOT_BUSY;
+    pl->next_lookup++;
+    pthread_mutex_unlock(&pl->lock);
+
+    hits = __classify(pl, s);
+
+    pthread_mutex_lock(&pl->lock);
+    pl->hits += hits;
+    s->state = SLOT_DONE;
+    pthread_cond_broadcast(&pl->changed);
+  }
+  pthread_mutex_unlock(&pl->lock);
+  return NULL;
+}
+
+static void *writer(void *arg)
+{
+  struct pipeline *pl = arg;
+  struct slot *s;
+  uint64_t seq;
+  int err, stop;
+
+  for (seq = 0; ; seq++) {
+    s = &pl->slots[seq % pl->nslots];
+    pthread_mutex_lock(&pl->lock);
+    while (!pl->error && !(s->state == SLOT_DONE && s->seq == seq) && !(pl->eof && seq >= pl->nblocks))
+      pthread_cond_wait(&pl->changed, &pl->lock);
+    stop = pl->error || (pl->eof && seq >= pl->nblocks);
+    pthread_mutex_unlock(&pl->lock);
+    if (stop)
+      break;
+
+    err = __write_full(pl->out_fd, s->out, s->n * pl->value_bytes);
+    if (!err && pl->map)
+      madvise((void *) ((uintptr_t) s->keys & ~(uintptr_t) 4095), s->n * pl->key_bytes, MADV_DONTNEED);
+
+    pthread_mutex_lock(&pl->lock);
+    if (err) {
+      perror("write");
+      pl->error = 1;
+    }
+    pl->keys += s->n;
+    s->state = SLOT_EMPTY;
+    pthread_cond_broadcast(&pl->changed);
+    pthread_mutex_unlock(&pl->lock);
+  }
+  return NULL;
+}
+
+static void __usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s (-r rules | -s snapshot) [-k 32|64] [-w 32|64] [-j threads]"
+          " [-b keys_per_block] [-o output] [keys]\n"
+          "  rules: \"inf sup value\" per line. keys: binary file (default: stdin).\n"
+          "  output: binary column of values, 0 if no range matched (default: stdout).\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+  const char *rules = NULL, *snapshot = NULL, *output = NULL;
+  int opt, i, nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t rthread, wthread, *workers;
+  struct pipeline pl;
+  struct stat st;
+  double t;
+
+  memset(&pl, 0, sizeof(pl));
+  pl.key_bytes = 4;
+  pl.value_bytes = 4;
+  pl.block = 1 << 18;
+  while ((opt = getopt(argc, argv, "r:s:k:w:j:b:o:h")) != -1) {
+    switch (opt) {
+    case 'r': rules = optarg; break;
+    case 's': snapshot = optarg; break;
+    case 'k': pl.key_bytes = atoi(optarg) / 8; break;
+    case 'w': pl.value_bytes = atoi(optarg) / 8; break;
+    case 'j': nthreads = atoi(optarg); break;
+    case 'b': pl.block = strtoul(optarg, NULL, 0); break;
+    case 'o': output = optarg; break;
+    default:
+      __usage(argv[0]);
+      return 1;
+    }
+  }
+  if ((!rules == !snapshot) || (pl.key_bytes != 4 && pl.key_bytes != 8) ||
+      (pl.value_bytes != 4 && pl.value_bytes != 8) || !pl.block || optind < argc - 1) {
+    __usage(argv[0]);
+    return 1;
+  }
+  if (nthreads < 1)
+    nthreads = 1;
+
+  pl.tree = rules ? __load_rules(rules, nthreads) : interval_tree_open_mmap(snapshot);
+  if (!pl.tree) {
+    fprintf(stderr, "The rules could not be loaded\n");
+    return 1;
+  }
+
+  pl.in_fd = optind < argc ? open(argv[optind], O_RDONLY) : STDIN_FILENO;
+  pl.out_fd = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+  if (pl.in_fd < 0 || pl.out_fd < 0) {
+    perror(pl.in_fd < 0 ? argv[optind] : output);
+    return 1;
+  }
+  // Regular files are mapped, streams are read in blocks
+  if (!fstat(pl.in_fd, &st) && S_ISREG(st.st_mode) && st.st_size >= pl.key_bytes) {
+    pl.map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, pl.in_fd, 0);
+    if (pl.map == MAP_FAILED) {
+      pl.map = NULL;
+    } else {
+      madvise((void *) pl.map, st.st_size, MADV_SEQUENTIAL);
+      pl.map_keys = st.st_size / pl.key_bytes;
+      if (st.st_size % pl.key_bytes)
+        fprintf(stderr, "Ignoring %zu trailing bytes of a partial key\n", (size_t) (st.st_size % pl.key_bytes));
+    }
+  }
+
+  // Enough blocks for every worker, the one being read and the one being written
+  pl.nslots = nthreads + 2;
+  pl.slots = calloc(pl.nslots, sizeof(struct slot));
+  workers = calloc(nthreads, sizeof(pthread_t));
+  if (!pl.slots || !workers) {
+    fprintf(stderr, "Not enough memory\n");
+    return 1;
+  }
+  for (i = 0; i < pl.nslots; i++) {
+    pl.slots[i].out = malloc(pl.block * pl.value_bytes);
+    pl.slots[i].buf = pl.map ? NULL : malloc(pl.block * pl.key_bytes);
+    if (!pl.slots[i].out || (!pl.map && !pl.slots[i].buf)) {
+      fprintf(stderr, "Not enough memory\n");
+      return 1;
+    }
+  }
+  pthread_mutex_init(&pl.lock, NULL);
+  pthread_cond_init(&pl.changed, NULL);
+
+  t = now();
+  pthread_create(&rthread, NULL, reader, &pl);
+  for (i = 0; i < nthreads; i++)
+    pthread_create(&workers[i], NULL, worker, &pl);
+  pthread_create(&wthread, NULL, writer, &pl);
+  pthread_join(rthread, NULL);
+  for (i = 0; i < nthreads; i++)
+    pthread_join(workers[i], NULL);
+  pthread_join(wthread, NULL);
+  t = now() - t;
+
+  fprintf(stderr, "%" PRIu64 " keys (%" PRIu64 " matched) in %.3f s: %.2f Mkeys/s, %.1f MB/s in, %.1f MB/s out\n",
+          pl.keys, pl.hits, t, pl.keys / t / 1e6, pl.keys * pl.key_bytes / t / 1e6,
+          pl.keys * pl.value_bytes / t / 1e6);
+
+  if (pl.map)
+    munmap((void *) pl.map, pl.map_keys * pl.key_bytes);
+  for (i = 0; i < pl.nslots; i++) {
+    free(pl.slots[i].out);
+    free(pl.slots[i].buf);
+  }
+  free(pl.slots);
+  free(workers);
+  if (output && close(pl.out_fd)) {
+    perror(output);
+    pl.error = 1;
+  }
+  pthread_mutex_destroy(&pl.lock);
+  pthread_cond_destroy(&pl.changed);
+  interval_tree_free(pl.tree);
+  return pl.error;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file epoch.c
+ * Epoch based reclamation.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "epoch.h"
+
+struct _retired_t {
+  void *p;
+  void (*release)(void *p);
+  uint64_t epoch; /* Epoch in which it was unpublished */
+  struct _retired_t *next;
+};
+
+struct _epoch_domain_t {
+  _Atomic uint64_t epoch;
+  pthread_mutex_t lock; /* Protects the lists, never taken by epoch_enter/epoch_exit */
+  epoch_reader_t *readers;
+  struct _retired_t *retired;
+  int nretired;
+  int waiting;                /* epoch_synchronize calls walking the readers */
+  epoch_reader_t *unregistered; /* Records that they might still reference */
+};
+
+epoch_domain_t* epoch_domain_new(void)
+{
+  epoch_domain_t* me;
+
+  me = calloc(1, sizeof(epoch_domain_t));
+  if (!me) return NULL;
+  atomic_init(&me->epoch, 1); // 0 means "outside a critical section"
+  pthread_mutex_init(&me->lock, NULL);
+  return me;
+}
+
+void epoch_domain_free(epoch_domain_t* me)
+{
+  struct _retired_t *t;
+  epoch_reader_t *r;
+
+  if (!me) return;
+
+  while ((t = me->retired)) {
+    me->retired = t->next;
+    t->release(t->p);
+    free(t);
+  }
+  while ((r = me->readers)) {
+    me->readers = r->next;
+    free(r);
+  }
+  while ((r = me->unregistered)) {
+    me->unregistered = r->unregistered;
+    free(r);
+  }
+  pthread_mutex_destroy(&me->lock);
+  free(me);
+}
+
+epoch_reader_t* epoch_register(epoch_domain_t* me)
+{
+  epoch_reader_t* r;
+
+  r = aligned_alloc(EPOCH_CACHE_LINE, sizeof(epoch_reader_t));
+  if (!r) return NULL;
+  memset(r, 0, sizeof(epoch_reader_t));
+  atomic_init(&r->epoch, 0);
+
+  pthread_mutex_lock(&me->lock);
+  r->next = me->readers;
+  me->readers = r;
+  pthread_mutex_unlock(&me->lock);
+  return r;
+}
+
+void epoch_unregister(epoch_domain_t* me, epoch_reader_t* r)
+{
+  epoch_reader_t **it;
+
+  pthread_mutex_lock(&me->lock);
+  for (it = &me->readers; *it; it = &(*it)->next) {
+    if (*it == r) {
+      *it = r->next;
+      break;
+    }
+  }
+  // A grace period in progress might be positioned on r: it is released by the last one
+  if (me->waiting) {
+    r->unregistered = me->unregistered;
+    me->unregistered = r;
+    r = NULL;
+  }
+  pthread_mutex_unlock(&me->lock);
+  free(r);
+}
+
+uint64_t epoch_current(epoch_domain_t* me)
+{
+  return atomic_load(&me->epoch);
+}
+
+void epoch_synchronize(epoch_domain_t* me)
+{
+  epoch_reader_t *r, *next, *freed = NULL;
+  uint64_t target, e;
+
+  target = atomic_fetch_add(&me->epoch, 1) + 1;
+
+  /* The lock is only taken to step through the list. The records unregistered meanwhile are
+   * kept (with their links) until no grace period is walking it. Readers registered later
+   * are inserted at the head and enter with the new epoch, so they are not visited. */
+  pthread_mutex_lock(&me->lock);
+  me->waiting++;
+  r = me->readers;
+  pthread_mutex_unlock(&me->lock);
+  while (r) {
+    while ((e = atomic_load(&r->epoch)) && e < target) {
+      sched_yield();
+    }
+    pthread_mutex_lock(&me->lock);
+    r = r->next;
+    pthread_mutex_unlock(&me->lock);
+  }
+
+  pthread_mutex_lock(&me->lock);
+  if (!--me->waiting) {
+    freed = me->unregistered;
+    me->unregistered = NULL;
+  }
+  pthread_mutex_unlock(&me->lock);
+  while ((r = freed)) {
+    next = r->unregistered;
+    free(r);
+    freed = next;
+  }
+}
+
+/* Oldest epoch in which a reader is inside, UINT64_MAX if none. The lock must be held. */
+static uint64_t __min_active(epoch_domain_t* me)
+{
+  epoch_reader_t *r;
+  uint64_t e, min = UINT64_MAX;
+
+  for (r = me->readers; r; r = r->next) {
+    e = atomic_load(&r->epoch);
+    if (e && e < min)
+      min = e;
+  }
+  return min;
+}
+
+int epoch_retire(epoch_domain_t* me, void *p, void (*release)(void *p))
+{
+  struct _retired_t *t;
+
+  t = malloc(sizeof(struct _retired_t));
+  if (!t) {
+    epoch_synchronize(me);
+    release(p);
+    return -1;
+  }
+  t->p = p;
+  t->release = release;
+  // Readers entering from now on get a greater epoch and cannot see p
+  t->epoch = atomic_fetch_add(&me->epoch, 1);
+
+  pthread_mutex_lock(&me->lock);
+  t->next = me->retired;
+  me->retired = t;
+  me->nretired++;
+  pthread_mutex_unlock(&me->lock);
+  return 0;
+}
+
+int epoch_reclaim(epoch_domain_t* me)
+{
+  struct _retired_t **it, *t, *freed = NULL;
+  uint64_t min;
+  int pending;
+
+  pthread_mutex_lock(&me->lock);
+  min = __min_active(me);
+  for (it = &me->retired; (t = *it); ) {
+    if (t->epoch < min) {
+      *it = t->next;
+      t->next = freed;
+      freed = t;
+      me->nretired--;
+    } else {
+      it = &t->next;
+    }
+  }
+  pending = me->nretired;
+  pthread_mutex_unlock(&me->lock);
+
+  while ((t = freed)) {
+    freed = t->next;
+    t->release(t->p);
+    free(t);
+  }
+  return pending;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file epoch.h
+ * Epoch based reclamation. Readers announce the epoch in which they enter a read-side
+ * critical section; a writer that unpublishes a structure can free it once every reader
+ * that was inside at that moment has left (a grace period).
+ *
+ * Readers never block nor write shared cache lines: each one owns a record padded to a
+ * cache line.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define EPOCH_CACHE_LINE 64
+
+typedef struct _epoch_domain_t epoch_domain_t; /**< Opaque structure of the domain */
+
+/**
+ * @brief Record of a reader thread. It must be obtained with epoch_register and used by a single thread.
+ */
+struct _epoch_reader_t {
+  _Atomic uint64_t epoch;          /**< Epoch of the current critical section, 0 if outside */
+  struct _epoch_reader_t *next;
+  struct _epoch_reader_t *unregistered; /**< Next record released while a grace period was waiting */
+  char pad[EPOCH_CACHE_LINE - sizeof(uint64_t) - 2 * sizeof(void *)];
+} __attribute__((aligned(EPOCH_CACHE_LINE)));
+typedef struct _epoch_reader_t epoch_reader_t;
+
+/**
+ * @brief Initializes a new domain.
+ *
+ * @return NULL if the domain could not be generated.
+ */
+epoch_domain_t* epoch_domain_new(void);
+
+/**
+ * @brief Free a domain. Every pending retired pointer is released, so no reader can be inside.
+ *
+ * @param me The returned value by the epoch_domain_new function.
+ */
+void epoch_domain_free(epoch_domain_t* me);
+
+/**
+ * @brief Register a reader. It can be called from any thread.
+ *
+ * @param me A domain that has been previously allocated by a call to epoch_domain_new.
+ * @return The record that the thread will use, NULL if it could not be allocated.
+ */
+epoch_reader_t* epoch_register(epoch_domain_t* me);
+
+/**
+ * @brief Unregister a reader. It must be outside any critical section.
+ *
+ * @param me A domain that has been previously allocated by a call to epoch_domain_new.
+ * @param r The returned value by epoch_register.
+ */
+void epoch_unregister(epoch_domain_t* me, epoch_reader_t* r);
+
+/**
+ * @brief Current epoch of the domain. Used by epoch_enter.
+ */
+uint64_t epoch_current(epoch_domain_t* me);
+
+/**
+ * @brief Enter a read-side critical section. Every pointer published before and loaded after
+ * this call stays valid until epoch_exit.
+ *
+ * @param me A domain that has been previously allocated by a call to epoch_domain_new.
+ * @param r The record of the calling thread.
+ */
+static inline void epoch_enter(epoch_domain_t* me, epoch_reader_t* r)
+{
+  atomic_store(&r->epoch, epoch_current(me));
+}
+
+/**
+ * @brief Leave a read-side critical section.
+ *
+ * @param r The record of the calling thread.
+ */
+static inline void epoch_exit(epoch_reader_t* r)
+{
+  atomic_store_explicit(&r->epoch, 0, memory_order_release);
+}
+
+/**
+ * @brief Start a new epoch and wait until every reader that entered before has left.
+ * After returning, nothing unpublished before the call can be referenced by a reader.
+ * The lock of the domain is not held while waiting: readers can register and unregister,
+ * and other writers can retire and reclaim, in the meantime.
+ *
+ * @param me A domain that has been previously allocated by a call to epoch_domain_new.
+ */
+void epoch_synchronize(epoch_domain_t* me);
+
+/**
+ * @brief Defer the release of a pointer that has already been unpublished until every reader
+ * that could be using it has left. It does not block. Writers must be serialized by the caller.
+ *
+ * @param me A domain that has been previously allocated by a call to epoch_domain_new.
+ * @param p The pointer to release.
+ * @param release The function that releases it.
+ * @return 0 on success, -1 if the memory could not be allocated (p is released after a synchronization).
+ */
+int epoch_retire(epoch_domain_t* me, void *p, void (*release)(void *p));
+
+/**
+ * @brief Release the retired pointers that no reader can be using. It does not block.
+ *
+ * @param me A domain that has been previously allocated by a call to epoch_domain_new.
+ * @return The number of pointers still pending.
+ */
+int epoch_reclaim(epoch_domain_t* me);
+
+#endif /* EPOCH_H */
@@ -0,0 +1,44 @@
+/**
+ * @file example_cpp.cpp
+ * Example of how to work with the C++ interval tree (interval_tree.hpp).
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <string>
+
+#include "interval_tree.hpp"
+
+int main()
+{
+  // The ids are stored by value: no need to encapsulate them as pointers
+  interval_trees::interval_tree<int64_t, unsigned int> intervalt(8);
+  interval_trees::interval_tree<int64_t, std::string> names;
+  int64_t inf = 0, sup = 20;
+  unsigned int id = 0x69;
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    printf("Inserting interval [%ld,%ld] with id %X\n", (long) inf, (long) sup, id);
+    intervalt.insert(inf, sup, id);
+    names.insert(inf, sup, "range " + std::to_string(i));
+    inf = sup + 1;
+    sup = sup + 20;
+    id++;
+  }
+
+  for (i = 0, id = 3; i < 8; i++, id += 20) {
+    const unsigned int *v = intervalt.query(id);
+    printf("Asking for integer %d. Got id: %X (%s)\n", id, v ? *v : 0, names.query(id) ? names.query(id)->c_str() : "-");
+  }
+
+  names.remove(0, 20);
+  printf("Ranges overlapping [0,45] after removing [0,20]:");
+  names.overlap_query(0, 45, [](const interval_trees::interval_tree<int64_t, std::string>::range_type &r, const std::string &name) {
+    printf(" %s [%ld,%ld]", name.c_str(), (long) r.inf, (long) r.sup);
+    return false;
+  });
+  printf("\nRanges: %zu. Height: %d. Memory: %zu bytes\n", intervalt.size(), intervalt.height(), intervalt.memory());
+  return 0;
+}
@@ -26,7 +26,7 @@ int main()
   id = INT_TO_POINTER(0x69); // We could use a structure but it also can be an integer encapsulated as a pointer
   int i;
   for (i = 0; i < 8; i++) {
-    printf("Inserting interval [%ld,%ld] with id %X\n", r.inf, r.sup, POINTER_TO_INT(id));
+    printf("Inserting interval [%ld,%ld] with id %X\n", (long) r.inf, (long) r.sup, POINTER_TO_INT(id));
     interval_tree_insert(intervalt, &r, id);
     r.inf = r.sup + 1;
     r.sup = r.sup + 20;
@@ -36,6 +36,12 @@ int main()
   for (i = 0, id = INT_TO_POINTER(3); i < 8; i++, id += 20) {
     printf("Asking for integer %d. Got id: %X\n", POINTER_TO_INT(id), POINTER_TO_INT(interval_tree_query(intervalt, POINTER_TO_INT(id))));
   }
+  interval_tree_iterator_t it;
+  for (interval_tree_iterator_seek(intervalt, &it, 100); interval_tree_iterator_next(&it, &r, &id); ) {
+    printf("Range from 100 on: [%ld,%ld] with id %X\n", (long) r.inf, (long) r.sup, POINTER_TO_INT(id));
+  }
+
+  interval_tree_stats_print(intervalt);
   interval_tree_free(intervalt);
   return 0;
 }
\ No newline at end of file
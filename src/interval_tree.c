@@ -8,34 +8,38 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include "avl_tree.h"
-#include "interval_tree.h"
+#include <sys/mman.h>
+#include <pthread.h>
+#include "interval_tree_private.h"
 
 
 #define max(x,y) ((x) < (y) ? (y) : (x))
 #define min(x,y) ((x) > (y) ? (y) : (x))
 
+#ifdef INTERVAL_TREE_STATS
+/* Nodes visited by the query in progress in this thread, added to the tree once it finishes */
+static __thread uint64_t nodes_visited;
+#define STATS_VISIT() (nodes_visited++)
+#define STATS_QUERY(me, n) do {                       \
+    STATS_ADD(me, queries, n);                        \
+    STATS_ADD(me, nodes_visited, nodes_visited);      \
+    nodes_visited = 0;                                \
+  } while (0)
+#else
+#define STATS_VISIT() do {} while (0)
+#define STATS_QUERY(me, n) do {} while (0)
+#endif
 
-struct _interval_node_t {
-  int64_t max;
-  int64_t min;
-  range_t range;
-  void *v;
-};
-typedef struct _interval_node_t interval_node_t;
-
-struct _interval_tree_t {
-  avltree_t *tree;
-  interval_node_t *nodes;
-  void **multiple_query_return;
-  int *nodes_perm;
-  int size;
-  int count;
-};
 
+#ifndef INTERVAL_TREE_POOL
+/*
+ * Implicit heap backend: the AVL tree (avl_tree.c) stores the ranges at heap positions and
+ * nodes_perm maps every position to the entry of nodes that holds its augmented data.
+ */
 
 static int __child_l(const int idx)
 {
@@ -47,287 +51,1748 @@ static int __child_r(const int idx)
   return idx * 2 + 2;
 }
 
-static int __parent(const int idx)
+static int __grow(interval_tree_t* me, int size)
 {
-  assert(idx != 0);
-  return (idx - 1) / 2;
-}
+  int ii, end;
+  interval_node_t *array_nodes;
+  void **array_return;
 
-static long cmp_range(const void *e1, const void *e2)
-{
-  range_t *a, *b;
-  a = ((range_t *)e1);
-  b = ((range_t *)e2);
-  if (a->inf < b->inf) { // e2>e1
-    return 1;
-  } else if (a->inf == b->inf && a->sup == b->sup) {
-    return 0;
-  } else { // e2<e1
+  array_nodes = __interval_tree_alloc(&me->allocator, size * sizeof(interval_node_t));
+  array_return = __interval_tree_alloc(&me->allocator, (size + 1) * sizeof(void *));
+  if (!array_nodes || !array_return) {
+    __interval_tree_release(&me->allocator, array_nodes, size * sizeof(interval_node_t));
+    __interval_tree_release(&me->allocator, array_return, (size + 1) * sizeof(void *));
     return -1;
   }
+  /* copy old data across to new array */
+  memcpy(array_nodes, me->nodes, me->size * sizeof(interval_node_t));
+  /* Update the references  to the key in this module */
+  for (ii = 0, end = me->tree->size; ii < end; ii++) {
+    if (me->tree->nodes[ii].key)
+      me->tree->nodes[ii].key = &(array_nodes[me->nodes_perm[ii]].range);
+  }
+
+  STATS_ADD(me, enlargements, 1);
+  STATS_ADD(me, bytes_copied, me->size * sizeof(interval_node_t));
+
+  /* swap arrays */
+  __interval_tree_release(&me->allocator, me->nodes, me->size * sizeof(interval_node_t));
+  __interval_tree_release(&me->allocator, me->multiple_query_return, (me->size + 1) * sizeof(void *));
+  me->nodes      = array_nodes;
+  me->multiple_query_return = array_return;
+  me->size = size;
+  return 0;
 }
 
+static int __enlarge(interval_tree_t* me)
+{
+  /* double capacity */
+  return __grow(me, me->size * 2);
+}
 
-static void __enlarge(interval_tree_t* me)
+/* The AVL tree might grow its array during an insertion: keep nodes_perm as large as the
+ * array of the AVL tree. */
+static int __perm_reserve(interval_tree_t* me, int idx)
 {
-  int ii, end;
-  interval_node_t *array_nodes;
+  int ii, perm_size;
   int *array_perms;
-  int prev_node;
-  avltree_iterator_t iter;
-  node_t *n;
 
-  /* double capacity */
-  array_nodes = calloc(me->size * 2, sizeof(interval_node_t));
-  array_perms = calloc(me->size * 4, sizeof(int));
-  memset(array_perms, -1, me->size * 2);
-  /* copy old data across to new array */
-  for (ii = 0, end = me->size; ii < end; ii++) {
-    memcpy(&array_nodes[ii], &me->nodes[ii], sizeof(interval_node_t));
-  }
-  for (ii = 0, end = 2 * me->size; ii < end; ii++) {
-    memcpy(&array_perms[ii], &me->nodes_perm[ii], sizeof(int));
+  if (idx < me->perm_size)
+    return 0;
+
+  for (perm_size = me->perm_size ? me->perm_size : 1; perm_size <= idx; perm_size *= 2);
+  if (perm_size < me->tree->size)
+    perm_size = me->tree->size;
+  array_perms = __interval_tree_realloc(&me->allocator, me->nodes_perm, me->perm_size * sizeof(int),
+                                        perm_size * sizeof(int));
+  if (!array_perms)
+    return -1;
+  if (me->perm_size) {
+    STATS_ADD(me, enlargements, 1);
+    STATS_ADD(me, bytes_copied, me->perm_size * sizeof(int));
   }
-  /* Update the references  to the key in this module ... Not the most efficient aspect */
-  avltree_iterator(me->tree, &iter);
-  prev_node = iter.current_node;
-  while ( (n = avltree_iterator_next(me->tree, &iter)) && prev_node != iter.current_node) {
-    n->key = &(array_nodes[array_perms[prev_node]].range);
-    prev_node = iter.current_node;
+  for (ii = me->perm_size; ii < perm_size; ii++) {
+    array_perms[ii] = -1;
   }
-
-  /* swap arrays */
-  free(me->nodes);
-  free(me->nodes_perm);
-  me->nodes      = array_nodes;
   me->nodes_perm = array_perms;
-  me->size *= 2;
-  free(me->multiple_query_return);
-  me->multiple_query_return = calloc(me->size + 1, sizeof(void *));
+  me->perm_size = perm_size;
+  return 0;
 }
 
-
+/* A node was moved by the AVL tree: its augmented data is still valid, since it describes
+ * the same subtree. */
 static void up_rebalance(int idx, int towards, void *user)
 {
   interval_tree_t* me = (interval_tree_t*)user;
 
-  if (towards !=  __child_r(idx) && avltree_get_from_idx(me->tree, __child_r(idx)) && avltree_get_from_idx(me->tree, __child_l(idx)) && avltree_get_from_idx(me->tree, __child_r(__child_l(idx))) ) {
-    me->nodes[me->nodes_perm[idx]].max =  max(max(me->nodes[me->nodes_perm[__child_r(__child_l(idx))]].max, me->nodes[me->nodes_perm[__child_l(idx)]].max), me->nodes[me->nodes_perm[idx]].range.sup );
-    me->nodes[me->nodes_perm[idx]].min =  min(min(me->nodes[me->nodes_perm[__child_r(__child_l(idx))]].min, me->nodes[me->nodes_perm[__child_l(idx)]].min), me->nodes[me->nodes_perm[idx]].range.inf );
-  } else if (avltree_get_from_idx(me->tree, __child_l(idx)) && avltree_get_from_idx(me->tree, __child_r(__child_l(idx)))) {
-    me->nodes[me->nodes_perm[idx]].max =    max(me->nodes[me->nodes_perm[__child_r(__child_l(idx))]].max,  me->nodes[me->nodes_perm[idx]].range.sup );
-    me->nodes[me->nodes_perm[idx]].min =    min(me->nodes[me->nodes_perm[__child_r(__child_l(idx))]].min,  me->nodes[me->nodes_perm[idx]].range.inf );
-  } else if (towards !=  __child_r(idx) && avltree_get_from_idx(me->tree, __child_r(idx))) {
-    me->nodes[me->nodes_perm[idx]].max =  max(me->nodes[me->nodes_perm[__child_r(idx)]].max,  me->nodes[me->nodes_perm[idx]].range.sup );
-    me->nodes[me->nodes_perm[idx]].min =  min(me->nodes[me->nodes_perm[__child_r(idx)]].min,  me->nodes[me->nodes_perm[idx]].range.inf );
-  } else {
-    me->nodes[me->nodes_perm[idx]].max = me->nodes[me->nodes_perm[idx]].range.sup;
-    me->nodes[me->nodes_perm[idx]].min = me->nodes[me->nodes_perm[idx]].range.inf;
-  }
+  STATS_ADD(me, shift_up, 1);
+  assert(towards < me->perm_size); // The AVL tree does not grow its array while it moves nodes
   me->nodes_perm[towards] = me->nodes_perm[idx];
   me->nodes_perm[idx] = -1;
-
-  if (towards) { // If we do change the parent, propagate the maximum
-    int current_node = __parent(towards);
-    while (current_node != 0 && me->nodes_perm[current_node] != -1) {
-      me->nodes[me->nodes_perm[current_node]].max = max(me->nodes[me->nodes_perm[current_node]].max, me->nodes[me->nodes_perm[towards]].max);
-      me->nodes[me->nodes_perm[current_node]].min = min(me->nodes[me->nodes_perm[current_node]].min, me->nodes[me->nodes_perm[towards]].min);
-      current_node = __parent(current_node);
-    }
-
-    if (me->nodes_perm[current_node] != -1) {
-      me->nodes[me->nodes_perm[current_node]].max = max(me->nodes[me->nodes_perm[current_node]].max, me->nodes[me->nodes_perm[towards]].max);
-      me->nodes[me->nodes_perm[current_node]].min = min(me->nodes[me->nodes_perm[current_node]].min, me->nodes[me->nodes_perm[towards]].min);
-    }
-  }
 }
 
 static void down_rebalance(int idx, int towards, void *user)
 {
   interval_tree_t* me = (interval_tree_t*)user;
 
-  if (towards !=  __child_l(idx) && avltree_get_from_idx(me->tree, __child_l(idx)) && avltree_get_from_idx(me->tree, __child_r(idx)) && avltree_get_from_idx(me->tree, __child_l(__child_r(idx))) ) {
-    me->nodes[me->nodes_perm[idx]].max =  max(max(me->nodes[me->nodes_perm[__child_l(__child_r(idx))]].max, me->nodes[me->nodes_perm[__child_l(idx)]].max), me->nodes[me->nodes_perm[idx]].range.sup );
-  } else if (avltree_get_from_idx(me->tree, __child_r(idx)) && avltree_get_from_idx(me->tree, __child_l(__child_r(idx)))) {
-    me->nodes[me->nodes_perm[idx]].max =    max(me->nodes[me->nodes_perm[__child_l(__child_r(idx))]].max,  me->nodes[me->nodes_perm[idx]].range.sup );
-  } else if (towards !=  __child_l(idx) && avltree_get_from_idx(me->tree, __child_l(idx))) {
-    me->nodes[me->nodes_perm[idx]].max =  max(me->nodes[me->nodes_perm[__child_l(idx)]].max,  me->nodes[me->nodes_perm[idx]].range.sup );
-  } else {
-    me->nodes[me->nodes_perm[idx]].max = me->nodes[me->nodes_perm[idx]].range.sup;
-  }
-
+  STATS_ADD(me, shift_down, 1);
+  assert(towards < me->perm_size);
   me->nodes_perm[towards] = me->nodes_perm[idx];
   me->nodes_perm[idx] = -1;
 }
 
+/* Augmented data of the node at idx computed from the ones of its children */
+static void __augment(interval_tree_t* me, int idx, interval_node_t *n)
+{
+  __node_reset(n);
+  if (avltree_get_from_idx(me->tree, __child_l(idx)))
+    __node_merge(n, &me->nodes[me->nodes_perm[__child_l(idx)]]);
+  if (avltree_get_from_idx(me->tree, __child_r(idx)))
+    __node_merge(n, &me->nodes[me->nodes_perm[__child_r(idx)]]);
+}
+
+/* The children of idx changed: recompute the augmented data from them. */
+static int update_augmentation(int idx, void *user)
+{
+  interval_tree_t* me = (interval_tree_t*)user;
+  interval_node_t *n = &me->nodes[me->nodes_perm[idx]];
+  interval_node_t updated = *n;
+
+  __augment(me, idx, &updated);
+  if (updated.max == n->max && updated.min == n->min && updated.min_width == n->min_width &&
+      updated.min_sup == n->min_sup && updated.max_inf == n->max_inf && updated.ranges == n->ranges)
+    return 0;
+  *n = updated;
+  return 1;
+}
+
 
 interval_tree_t* interval_tree_new(int initial_size)
+{
+  return interval_tree_new_with_allocator(initial_size, NULL);
+}
+
+interval_tree_t* interval_tree_new_with_allocator(int initial_size, const interval_tree_allocator_t *allocator)
 {
   interval_tree_t* me;
+  avltree_allocator_t avl_allocator;
 
-  me = calloc(1, sizeof(interval_tree_t));
+  if (!allocator)
+    allocator = &__interval_tree_default_allocator;
+  if (initial_size < 1)
+    initial_size = 1;
+  me = __interval_tree_alloc(allocator, sizeof(interval_tree_t));
+  if (!me)
+    return NULL;
+  me->allocator = *allocator;
   me->size = initial_size;
-  me->nodes = calloc( initial_size, sizeof(interval_node_t));
-  me->nodes_perm = calloc( 2 * initial_size, sizeof(int));
-  memset(me->nodes_perm, -1, 2 * initial_size);
-  me->tree = avltree_new(initial_size, cmp_range);
-  me->multiple_query_return = calloc(initial_size + 1, sizeof(void *));
+  me->nodes = __interval_tree_alloc(allocator, initial_size * sizeof(interval_node_t));
+  me->multiple_query_return = __interval_tree_alloc(allocator, (initial_size + 1) * sizeof(void *));
+  /* The AVL tree takes its array from the same allocator */
+  avl_allocator.allocate = allocator->allocate;
+  avl_allocator.release = allocator->release;
+  avl_allocator.ctx = allocator->ctx;
+  me->tree = avltree_new_with_allocator(initial_size, cmp_range, &avl_allocator);
+  if (!me->nodes || !me->multiple_query_return || !me->tree || __perm_reserve(me, me->tree->size - 1)) {
+    interval_tree_free(me);
+    return NULL;
+  }
   set_shift_up_callback(me->tree, up_rebalance, me);
   set_shift_down_callback(me->tree, down_rebalance, me);
+  set_update_callback(me->tree, update_augmentation, me);
   return me;
 }
 
-void interval_tree_free(interval_tree_t* me)
+struct _build_sorted_t {
+  interval_tree_t* me;
+  range_t *ranges;
+  void **values;
+  void **keys, **vals;
+  int *slots;
+};
+
+static void __build_fill_nodes(void *arg, int lo, int hi)
 {
-  if (me) {
-    avltree_free(me->tree);
-    free(me->nodes);
-    free(me->nodes_perm);
-    free(me->multiple_query_return);
-    free(me);
+  struct _build_sorted_t *b = arg;
+  int i;
+
+  for (i = lo; i < hi; i++) {
+    b->me->nodes[i].range = b->ranges[i];
+    b->me->nodes[i].v = b->values[i];
+    b->keys[i] = &b->me->nodes[i].range;
+    b->vals[i] = b->values[i];
+  }
+}
+
+static void __build_clear_perm(void *arg, int lo, int hi)
+{
+  struct _build_sorted_t *b = arg;
+  int i;
+
+  for (i = lo; i < hi; i++)
+    b->me->nodes_perm[i] = -1;
+}
+
+static void __build_fill_perm(void *arg, int lo, int hi)
+{
+  struct _build_sorted_t *b = arg;
+  int i;
+
+  for (i = lo; i < hi; i++)
+    b->me->nodes_perm[b->slots[i]] = i;
+}
+
+/* Children are always stored after their parent: a reverse sweep of the levels of the
+ * subtree rooted at idx computes the augmented data bottom-up */
+static void __augment_levels(interval_tree_t* me, int idx)
+{
+  long first[INTERVAL_TREE_MAX_DEPTH], i, last;
+  int levels = 0;
+
+  for (i = idx; i < me->tree->size && levels < INTERVAL_TREE_MAX_DEPTH; i = i * 2 + 1)
+    first[levels++] = i;
+  while (levels--) {
+    last = min(first[levels] + (1L << levels), (long) me->tree->size);
+    for (i = last - 1; i >= first[levels]; i--) {
+      if (avltree_get_from_idx(me->tree, i))
+        __augment(me, i, &me->nodes[me->nodes_perm[i]]);
+    }
+  }
+}
+
+struct _augment_args_t {
+  interval_tree_t* me;
+  int idx;
+  int threads;
+};
+
+/* The two subtrees of idx are augmented by different threads, then idx itself */
+static void *__augment_subtree(void *p)
+{
+  struct _augment_args_t *a = p, l, r;
+  interval_tree_t* me = a->me;
+
+  if (a->idx >= me->tree->size || !avltree_get_from_idx(me->tree, a->idx))
+    return NULL;
+  if (a->threads <= 1 || (1L << me->tree->nodes[a->idx].height) < PARALLEL_GRAIN) {
+    __augment_levels(me, a->idx);
+    return NULL;
+  }
+  l = r = *a;
+  l.idx = __child_l(a->idx);
+  l.threads = a->threads / 2;
+  r.idx = __child_r(a->idx);
+  r.threads = a->threads - l.threads;
+  __interval_tree_fork(__augment_subtree, &l, __augment_subtree, &r);
+  __augment(me, a->idx, &me->nodes[me->nodes_perm[a->idx]]);
+  return NULL;
+}
+
+interval_tree_t* __interval_tree_build_sorted(range_t *ranges, void **values, int n, int nthreads,
+                                              const interval_tree_allocator_t *allocator)
+{
+  struct _build_sorted_t b;
+  struct _augment_args_t a;
+  interval_tree_t* me;
+
+  me = interval_tree_new_with_allocator(n > 0 ? n : 1, allocator);
+  b.me = me;
+  b.ranges = ranges;
+  b.values = values;
+  b.keys  = calloc(n > 0 ? n : 1, sizeof(void *));
+  b.vals  = calloc(n > 0 ? n : 1, sizeof(void *));
+  b.slots = calloc(n > 0 ? n : 1, sizeof(int));
+  if (!me || !b.keys || !b.vals || !b.slots) {
+    interval_tree_free(me);
+    me = NULL;
+    goto out;
+  }
+
+  __interval_tree_parallel_for(nthreads, n, __build_fill_nodes, &b);
+  if (avltree_build_parallel(me->tree, b.keys, b.vals, n, b.slots, nthreads)) {
+    interval_tree_free(me);
+    me = NULL;
+    goto out;
   }
+  if (__perm_reserve(me, me->tree->size - 1)) {
+    interval_tree_free(me);
+    me = NULL;
+    goto out;
+  }
+  __interval_tree_parallel_for(nthreads, me->perm_size, __build_clear_perm, &b);
+  __interval_tree_parallel_for(nthreads, n, __build_fill_perm, &b);
+
+  a.me = me;
+  a.idx = 0;
+  a.threads = nthreads;
+  __augment_subtree(&a);
+  me->count = n;
+  me->used = n;
+
+out:
+  free(b.keys);
+  free(b.vals);
+  free(b.slots);
+  return me;
 }
 
-void interval_tree_insert(interval_tree_t* me, range_t *r, void *v)
+/* Index of the node that the next insertion will use: a released one if there is any.
+ * -1 if the memory could not be allocated. */
+static int __node_next(interval_tree_t* me)
+{
+  if (me->nfree)
+    return me->free_nodes[me->nfree - 1];
+  if (me->used >= me->size && __enlarge(me))
+    return -1;
+  return me->used;
+}
+
+int __interval_tree_add(interval_tree_t* me, range_t *r, void *v)
 {
-  void *tv;
   void *tk;
-  int position;
+  int position, prev_count, node;
+
+  node = __node_next(me);
+  if (node < 0)
+    return -1;
+  me->generation++;
+  memcpy(&(me->nodes[node].range), r, sizeof(range_t));
+  __node_reset(&me->nodes[node]);
+  tk = &me->nodes[node].range;
+  me->nodes[node].v = v;  // Value  of the node (id of the network...)
+  me->nodes[node].merged = 0;
+
+  prev_count = avltree_count(me->tree);
+  position = avltree_insert(me->tree, tk, v);
+  if (position < 0)
+    return -1;
+  if (prev_count == avltree_count(me->tree)) {
+    // Same range: just update the value of the node already stored
+    me->nodes[me->nodes_perm[position]].v = v;
+    return 0;
+  }
+  if (__perm_reserve(me, me->tree->size - 1)) {
+    // Undo the insertion: the new leaf is removed without any rotation
+    avltree_remove(me->tree, tk);
+    return -1;
+  }
+  me->nodes_perm[position] = node;
+  if (me->nfree)
+    me->nfree--;
+  else
+    me->used++;
+  me->count++;
+
+  // Propagate the maximum and minimum and restore the balance of the tree
+  if (position) {
+    rebalance(me->tree, position);
+  }
+  return 0;
+}
+
+int __interval_tree_delete(interval_tree_t* me, range_t *r)
+{
+  int position, node;
+
+  position = avltree_get_idx(me->tree, r);
+  if (position < 0)
+    return -1;
+
+  if (__interval_tree_free_reserve(me, 1))
+    return -1;
 
-  if (me->count >= me->size ) {
-    __enlarge(me);
+  /* The AVL tree fills the hole with the in-order predecessor (or the right subtree) through
+   * the shift callbacks. If the node was a leaf nothing is moved, so the position is released
+   * here. The max/min fields of its ancestors are recomputed by the update callback while
+   * the tree is rebalanced. */
+  node = me->nodes_perm[position];
+  me->nodes_perm[position] = -1;
+  avltree_remove(me->tree, r);
+
+  me->free_nodes[me->nfree++] = node;
+  me->count--;
+  me->generation++;
+  return 0;
+}
+
+void __interval_tree_swap(interval_tree_t* me, interval_tree_t* other)
+{
+  interval_tree_t tmp = *me;
+
+  *me = *other;
+  *other = tmp;
+  /* The callbacks of the AVL trees receive the structure that owns them */
+  set_shift_up_callback(me->tree, up_rebalance, me);
+  set_shift_down_callback(me->tree, down_rebalance, me);
+  set_update_callback(me->tree, update_augmentation, me);
+  set_shift_up_callback(other->tree, up_rebalance, other);
+  set_shift_down_callback(other->tree, down_rebalance, other);
+  set_update_callback(other->tree, update_augmentation, other);
+}
+
+int __interval_tree_reserve_nodes(interval_tree_t* me, int n)
+{
+  int size;
+
+  if (n > me->size && __grow(me, n))
+    return -1;
+  /* Positions of a perfectly balanced tree of n ranges, two more levels for an AVL tree that is
+   * not perfect and the extra level that the rotations need */
+  for (size = 1; size < n; size = size * 2 + 1);
+  if (avltree_reserve(me->tree, (size + 1) * 8 - 1))
+    return -1;
+  return __perm_reserve(me, me->tree->size - 1);
+}
+
+#endif /* INTERVAL_TREE_POOL */
+
+static void *__default_allocate(size_t size, void *ctx __attribute__((unused)))
+{
+  return malloc(size);
+}
+
+static void *__default_reallocate(void *ptr, size_t old_size __attribute__((unused)), size_t size,
+                                  void *ctx __attribute__((unused)))
+{
+  return realloc(ptr, size);
+}
+
+static void __default_release(void *ptr, size_t size __attribute__((unused)), void *ctx __attribute__((unused)))
+{
+  free(ptr);
+}
+
+const interval_tree_allocator_t __interval_tree_default_allocator = {
+  __default_allocate, __default_reallocate, __default_release, NULL
+};
+
+void *__interval_tree_alloc(const interval_tree_allocator_t *a, size_t size)
+{
+  void *ptr = a->allocate(size, a->ctx);
+
+  if (ptr)
+    memset(ptr, 0, size);
+  return ptr;
+}
+
+void *__interval_tree_realloc(const interval_tree_allocator_t *a, void *ptr, size_t old_size, size_t size)
+{
+  void *array;
+
+  if (a->reallocate)
+    return a->reallocate(ptr, old_size, size, a->ctx);
+  array = a->allocate(size, a->ctx);
+  if (array && ptr) {
+    memcpy(array, ptr, old_size < size ? old_size : size);
+    a->release(ptr, old_size, a->ctx);
   }
-  memcpy(&(me->nodes[me->count].range), r, sizeof(range_t));
-  me->nodes[me->count].max = me->nodes[me->count].range.sup;
-  tv = (void *) me->nodes[me->count].max;
-  tk = &me->nodes[me->count].range;
-  me->nodes[me->count].v = v;  // Value  of the node (id of the network...)
+  return array;
+}
+
+void __interval_tree_release(const interval_tree_allocator_t *a, void *ptr, size_t size)
+{
+  if (ptr)
+    a->release(ptr, size, a->ctx);
+}
+
+int __interval_tree_free_reserve(interval_tree_t* me, int n)
+{
+  int *array_free;
+  int free_size;
 
-  position = avltree_insert(me->tree, tk, tv);
-  me->nodes_perm[position] = me->count;
+  if (me->nfree + n <= me->free_size)
+    return 0;
+  free_size = me->free_size ? me->free_size * 2 : 16;
+  while (free_size < me->nfree + n)
+    free_size *= 2;
+  array_free = __interval_tree_realloc(&me->allocator, me->free_nodes, me->free_size * sizeof(int),
+                                      free_size * sizeof(int));
+  if (!array_free)
+    return -1;
+  me->free_nodes = array_free;
+  me->free_size = free_size;
+  return 0;
+}
+
+int interval_tree_reserve(interval_tree_t* me, int n)
+{
+  int *array_free;
 
-  if (position > me->size ) {
-    __enlarge(me);
+  if (me->map) // Trees mapped from a snapshot are read-only
+    return -1;
+  if (__interval_tree_reserve_nodes(me, n))
+    return -1;
+  // Every stored range can be removed without growing the stack of released nodes
+  if (n > me->free_size) {
+    array_free = __interval_tree_realloc(&me->allocator, me->free_nodes, me->free_size * sizeof(int),
+                                        n * sizeof(int));
+    if (!array_free)
+      return -1;
+    me->free_nodes = array_free;
+    me->free_size = n;
   }
+  return 0;
+}
 
-  if (position) { // If we do not change the parent, propagate the maximum
-    int current_node = __parent(position);
-    while (current_node != 0) {
-      me->nodes[me->nodes_perm[current_node]].max = max(me->nodes[me->nodes_perm[current_node]].max, me->nodes[me->nodes_perm[position]].max);
-      current_node = __parent(current_node);
+void interval_tree_free(interval_tree_t* me)
+{
+  if (me) {
+    if (me->map) {
+      munmap(me->map, me->map_size);
+    } else {
+      avltree_free(me->tree);
+      __interval_tree_release(&me->allocator, me->nodes, me->size * sizeof(interval_node_t));
+      __interval_tree_release(&me->allocator, me->nodes_perm, me->perm_size * sizeof(int));
+      __interval_tree_release(&me->allocator, me->free_nodes, me->free_size * sizeof(int));
     }
-    me->nodes[me->nodes_perm[current_node]].max = max(me->nodes[me->nodes_perm[current_node]].max, me->nodes[me->nodes_perm[position]].max);
+    interval_tree_free(me->absorbed);
+    __interval_tree_release(&me->allocator, me->multiple_query_return, (me->size + 1) * sizeof(void *));
+    __interval_tree_release(&me->allocator, me, sizeof(interval_tree_t));
   }
+}
 
-  if (position) {
+void __interval_tree_fork(void *(*a)(void *), void *pa, void *(*b)(void *), void *pb)
+{
+  pthread_t thread;
+  int forked;
 
-    rebalance(me->tree, position);
+  forked = !pthread_create(&thread, NULL, a, pa);
+  if (!forked)
+    a(pa);
+  b(pb);
+  if (forked)
+    pthread_join(thread, NULL);
+}
 
+struct _parallel_for_t {
+  void (*fn)(void *arg, int lo, int hi);
+  void *arg;
+  int lo, hi;
+  int threads;
+};
+
+static void *__parallel_for(void *p)
+{
+  struct _parallel_for_t *f = p, l, r;
+
+  if (f->threads <= 1 || f->hi - f->lo < PARALLEL_GRAIN) {
+    f->fn(f->arg, f->lo, f->hi);
+    return NULL;
   }
+  l = r = *f;
+  l.threads = f->threads / 2;
+  r.threads = f->threads - l.threads;
+  l.hi = r.lo = f->lo + (int)((long)(f->hi - f->lo) * l.threads / f->threads);
+  __interval_tree_fork(__parallel_for, &l, __parallel_for, &r);
+  return NULL;
+}
 
-  me->count++;
+void __interval_tree_parallel_for(int nthreads, int n, void (*fn)(void *arg, int lo, int hi), void *arg)
+{
+  struct _parallel_for_t f = { fn, arg, 0, n, nthreads };
+
+  __parallel_for(&f);
+}
+
+struct _build_entry_t {
+  range_t range;
+  int idx;
+};
+
+static int cmp_build_entry(const void *e1, const void *e2)
+{
+  const struct _build_entry_t *a = e1, *b = e2;
+  long r = cmp_range(&b->range, &a->range);
+
+  if (r) return r > 0 ? 1 : -1;
+  return a->idx - b->idx; // Keep the insertion order between duplicates
+}
+
+struct _build_t {
+  range_t *ranges;
+  void **values;
+  struct _build_entry_t *entries;
+  range_t *sorted_ranges;
+  void **sorted_values;
+  int unsorted;           /**< Some pair of consecutive ranges is out of order */
+};
+
+static void __build_fill_entries(void *arg, int lo, int hi)
+{
+  struct _build_t *b = arg;
+  int i, unsorted = 0;
+
+  for (i = lo; i < hi; i++) {
+    b->entries[i].range = b->ranges[i];
+    b->entries[i].idx = i;
+    if (i && cmp_range(&b->ranges[i - 1], &b->ranges[i]) < 0)
+      unsorted = 1;
+  }
+  if (unsorted)
+    __atomic_store_n(&b->unsorted, 1, __ATOMIC_RELAXED);
+}
+
+static void __build_fill_sorted(void *arg, int lo, int hi)
+{
+  struct _build_t *b = arg;
+  int i;
+
+  for (i = lo; i < hi; i++) {
+    b->sorted_ranges[i] = b->entries[i].range;
+    b->sorted_values[i] = b->values ? b->values[b->entries[i].idx] : NULL;
+  }
+}
+
+struct _sort_args_t {
+  struct _build_entry_t *a, *tmp;
+  int n;
+  int threads;
+};
+
+/* Merge sort whose halves are sorted by different threads. The idx of the entries makes
+ * cmp_build_entry a total order, so the result is the same than the one of qsort. */
+static void *__sort(void *p)
+{
+  struct _sort_args_t *s = p, l, r;
+  int i, j, k;
+
+  if (s->threads <= 1 || s->n < PARALLEL_GRAIN) {
+    qsort(s->a, s->n, sizeof(struct _build_entry_t), cmp_build_entry);
+    return NULL;
+  }
+  l = r = *s;
+  l.n = s->n / 2;
+  l.threads = s->threads / 2;
+  r.a = s->a + l.n;
+  r.tmp = s->tmp + l.n;
+  r.n = s->n - l.n;
+  r.threads = s->threads - l.threads;
+  __interval_tree_fork(__sort, &l, __sort, &r);
+
+  for (i = 0, j = l.n, k = 0; i < l.n && j < s->n; k++)
+    s->tmp[k] = cmp_build_entry(&s->a[j], &s->a[i]) < 0 ? s->a[j++] : s->a[i++];
+  while (i < l.n)
+    s->tmp[k++] = s->a[i++];
+  while (j < s->n)
+    s->tmp[k++] = s->a[j++];
+  memcpy(s->a, s->tmp, s->n * sizeof(struct _build_entry_t));
+  return NULL;
+}
+
+interval_tree_t* interval_tree_build(range_t *ranges, void **values, int n)
+{
+  return interval_tree_build_parallel(ranges, values, n, 1);
+}
+
+interval_tree_t* interval_tree_build_parallel(range_t *ranges, void **values, int n, int nthreads)
+{
+  interval_tree_t* me = NULL;
+  struct _sort_args_t sort;
+  struct _build_t b = { ranges, values, NULL, NULL, NULL, 0 };
+  int i, m;
+
+  if (nthreads < 1)
+    nthreads = 1;
+  b.entries = calloc(n > 0 ? n : 1, sizeof(struct _build_entry_t));
+  b.sorted_ranges = calloc(n > 0 ? n : 1, sizeof(range_t));
+  b.sorted_values = calloc(n > 0 ? n : 1, sizeof(void *));
+  if (!b.entries || !b.sorted_ranges || !b.sorted_values) goto out;
+
+  __interval_tree_parallel_for(nthreads, n, __build_fill_entries, &b);
+  if (b.unsorted) {
+    sort.a = b.entries;
+    sort.n = n;
+    sort.threads = nthreads;
+    sort.tmp = nthreads > 1 ? malloc(n * sizeof(struct _build_entry_t)) : NULL;
+    if (nthreads > 1 && !sort.tmp)
+      sort.threads = 1;
+    __sort(&sort);
+    free(sort.tmp);
+  }
+
+  /* Same range implies an update of the value: the last one wins as in interval_tree_insert */
+  for (i = 0, m = 0; i < n; i++) {
+    if (m && !cmp_range(&b.entries[m - 1].range, &b.entries[i].range)) {
+      b.entries[m - 1] = b.entries[i];
+    } else {
+      b.entries[m++] = b.entries[i];
+    }
+  }
+
+  __interval_tree_parallel_for(nthreads, m, __build_fill_sorted, &b);
+  me = __interval_tree_build_sorted(b.sorted_ranges, b.sorted_values, m, nthreads, NULL);
+
+out:
+  free(b.entries);
+  free(b.sorted_ranges);
+  free(b.sorted_values);
+  return me;
 }
 
-static void * __interval_tree_query(interval_tree_t* me, int idx, int k)
+static void * __interval_tree_query(interval_tree_t* me, int idx, interval_key_t k)
 {
-  range_t * r;
+  interval_node_t *n;
   void *ret_value;
 
-  r =  avltree_get_from_idx(me->tree, idx);
-  if (r == NULL) {
+  n = __node_at(me, idx);
+  if (n == NULL) {
     return NULL;
   }
+  STATS_VISIT();
 
-  if (me->nodes[me->nodes_perm[idx]].max < k || me->nodes[me->nodes_perm[idx]].min > k ) {
+  if (n->max < k || n->min > k ) {
     return NULL;
   }
 
   // 1) If x overlaps with root's interval, return the root's interval.
-  if (r->inf <= k && r->sup >= k ) {
-    return me->nodes[me->nodes_perm[idx]].v;
+  if (n->range.inf <= k && n->range.sup >= k ) {
+    return n->v;
   }
 
   //2) If left child of root is not empty and the [min, max] range
   // contains the value of k, recur for the left child.
   // The condition is a base case in the recursive function.
-  if (!(ret_value = __interval_tree_query(me, __child_l(idx), k))) {
+  if (!(ret_value = __interval_tree_query(me, __tree_left(me, idx), k))) {
 
     //3) If right child of root is not empty and the [min, max] range
     // contains the value of k, recur for the right child.
     // The condition is a base case in the recursive function.
-    ret_value = __interval_tree_query(me, __child_r(idx), k);
+    ret_value = __interval_tree_query(me, __tree_right(me, idx), k);
   }
 
   return ret_value;
 }
 
-void *interval_tree_query(interval_tree_t* me, int k)
+void *interval_tree_query(interval_tree_t* me, interval_key_t k)
 {
-  return __interval_tree_query(me, 0, k);
+  void *v;
+
+  v = __interval_tree_query(me, __tree_root(me), k);
+  STATS_QUERY(me, 1);
+  return v;
 }
 
+#define BATCH_LANES 16
+#define BATCH_STACK 64
+
+/* State of one of the lookups advanced in lockstep by interval_tree_query_batch */
+struct _batch_lane_t {
+  int key;      /* Index of the key (-1 if the lane is idle) */
+  int idx;      /* Current position in the tree */
+  interval_node_t *node; /* Stored at idx, it has been prefetched */
+  int depth;    /* Pending right children */
+  int stack[BATCH_STACK];
+};
 
-static void __interval_tree_multiple_query(interval_tree_t* me, int idx, int k, int *ncoincidences)
+/* Move the lane to position idx and prefetch what the next step will read. Returns 0 if it is empty. */
+static int __batch_lane_load(interval_tree_t* me, struct _batch_lane_t *lane, int idx)
 {
-  range_t * r;
+  lane->idx = idx;
+  lane->node = __node_at(me, idx);
+  if (!lane->node)
+    return 0;
+  __builtin_prefetch(lane->node);
+#ifndef INTERVAL_TREE_POOL
+  if (__tree_left(me, idx) < me->perm_size)
+    __builtin_prefetch(&me->nodes_perm[__tree_left(me, idx)]);
+#endif
+  return 1;
+}
 
-  r =  avltree_get_from_idx(me->tree, idx);
-  if (r == NULL) {
-    me->multiple_query_return[*ncoincidences] = NULL;
-    return; // The output is unused
+/* Continue with the next pending right child. Returns 0 if the lookup is over. */
+static int __batch_lane_pop(interval_tree_t* me, struct _batch_lane_t *lane)
+{
+  while (lane->depth) {
+    if (__batch_lane_load(me, lane, lane->stack[--lane->depth]))
+      return 1;
   }
+  return 0;
+}
 
-  if (me->nodes[me->nodes_perm[idx]].max < k || me->nodes[me->nodes_perm[idx]].min > k ) {
-    me->multiple_query_return[*ncoincidences] = NULL;
-    return;
+/* Start a new lookup in the lane. Returns 0 if there are no more keys. */
+static int __batch_lane_start(interval_tree_t* me, struct _batch_lane_t *lane, void **out, int *next, int n)
+{
+  while (*next < n) {
+    lane->key = (*next)++;
+    lane->depth = 0;
+    if (__batch_lane_load(me, lane, __tree_root(me)))
+      return 1;
+    out[lane->key] = NULL;
   }
+  lane->key = -1;
+  return 0;
+}
 
-  // 1) If x overlaps with root's interval, return the root's interval.
-  if (r->inf <= k && r->sup >= k ) {
-    me->multiple_query_return[*ncoincidences] = me->nodes[me->nodes_perm[idx]].v;
-    (*ncoincidences)++;
+void interval_tree_query_batch(interval_tree_t* me, const interval_key_t *keys, int n, void **out)
+{
+  struct _batch_lane_t lanes[BATCH_LANES];
+  int i, next = 0, active = 0;
+
+  for (i = 0; i < BATCH_LANES; i++) {
+    active += __batch_lane_start(me, &lanes[i], out, &next, n);
   }
 
-  //2) If left child of root is not empty and the [min, max] range
-  // contains the value of k, recur for the left child.
-  // The condition is a base case in the recursive function.
-  __interval_tree_multiple_query(me, __child_l(idx), k, ncoincidences);
+  /* Every lane performs one step of the same depth-first search than __interval_tree_query
+   * per round: it inspects the node prefetched in the previous round and prefetches the next
+   * one, so the memory latency of all the lanes overlaps. */
+  while (active) {
+    for (i = 0; i < BATCH_LANES; i++) {
+      struct _batch_lane_t *lane = &lanes[i];
+      interval_node_t *node;
+      interval_key_t k;
+      int more;
 
-  //3) If right child of root is not empty and the [min, max] range
-  // contains the value of k, recur for the right child.
-  // The condition is a base case in the recursive function.
-  __interval_tree_multiple_query(me, __child_r(idx), k, ncoincidences);
+      if (lane->key < 0)
+        continue;
 
-  return;
+      node = lane->node;
+      STATS_VISIT();
+      k = keys[lane->key];
+      if (node->max < k || node->min > k) {
+        more = __batch_lane_pop(me, lane);
+      } else if (node->range.inf <= k && node->range.sup >= k && node->v) {
+        out[lane->key] = node->v;
+        active -= !__batch_lane_start(me, lane, out, &next, n);
+        continue;
+      } else if (node->range.inf <= k && node->range.sup >= k) {
+        // A NULL value is not a hit, the search goes on with the next subtree
+        more = __batch_lane_pop(me, lane);
+      } else {
+        assert(lane->depth < BATCH_STACK);
+        lane->stack[lane->depth++] = __tree_right(me, lane->idx);
+        more = __batch_lane_load(me, lane, __tree_left(me, lane->idx)) || __batch_lane_pop(me, lane);
+      }
+
+      if (!more) {
+        out[lane->key] = NULL;
+        active -= !__batch_lane_start(me, lane, out, &next, n);
+      }
+    }
+  }
+  STATS_QUERY(me, n);
 }
 
-void **interval_tree_multiple_query(interval_tree_t* me, int k)
+/* Visit every range that overlaps [a, b] (a == b for a stabbing query), in pre-order.
+ * Returns 1 if the visitor asked to stop. */
+static int __interval_tree_overlap(interval_tree_t* me, int idx, interval_key_t a, interval_key_t b, interval_tree_visitor_t visitor, void *user, int *ncoincidences)
 {
+  interval_node_t *n;
+
+  n = __node_at(me, idx);
+  if (n == NULL) {
+    return 0;
+  }
+  STATS_VISIT();
+
+  // The [min, max] range of the subtree does not overlap [a, b]
+  if (n->max < a || n->min > b ) {
+    return 0;
+  }
+
+  // 1) If [a, b] overlaps with root's interval, report the root's interval.
+  if (n->range.inf <= b && n->range.sup >= a ) {
+    (*ncoincidences)++;
+    if (visitor(&n->range, n->v, user))
+      return 1;
+  }
+
+  //2) If left child of root is not empty and the [min, max] range
+  // overlaps [a, b], recur for the left child.
+  // The condition is a base case in the recursive function.
+  if (__interval_tree_overlap(me, __tree_left(me, idx), a, b, visitor, user, ncoincidences))
+    return 1;
+
+  //3) Every range of the right subtree starts after the root's interval: skip it if the
+  // root already starts after b. Otherwise the condition is a base case as above.
+  if (n->range.inf > b)
+    return 0;
+  return __interval_tree_overlap(me, __tree_right(me, idx), a, b, visitor, user, ncoincidences);
+}
+
+struct _query_buffer_t {
+  void **buf;
+  int capacity;
+  int n;
+};
+
+static int __buffer_visitor(const range_t *r __attribute__((unused)), void *v, void *user)
+{
+  struct _query_buffer_t *b = (struct _query_buffer_t *)user;
+
+  if (b->n < b->capacity)
+    b->buf[b->n] = v;
+  b->n++;
+  return 0;
+}
+
+int interval_tree_multiple_query_r(interval_tree_t* me, interval_key_t k, void **buf, int capacity)
+{
+  struct _query_buffer_t b = { buf, capacity, 0 };
   int ncoincidences = 0;
+
+  __interval_tree_overlap(me, __tree_root(me), k, k, __buffer_visitor, &b, &ncoincidences);
+  STATS_QUERY(me, 1);
+  return ncoincidences;
+}
+
+int interval_tree_multiple_query_cb(interval_tree_t* me, interval_key_t k, interval_tree_visitor_t visitor, void *user)
+{
+  int ncoincidences = 0;
+
+  __interval_tree_overlap(me, __tree_root(me), k, k, visitor, user, &ncoincidences);
+  STATS_QUERY(me, 1);
+  return ncoincidences;
+}
+
+void **interval_tree_multiple_query(interval_tree_t* me, interval_key_t k)
+{
+  int ncoincidences;
+
+  ncoincidences = interval_tree_multiple_query_r(me, k, me->multiple_query_return, me->size);
   me->multiple_query_return[ncoincidences] = NULL;
-  __interval_tree_multiple_query(me, 0, k, &ncoincidences);
   return me->multiple_query_return;
 }
 
-static void __print(interval_tree_t* me, int idx, int d)
+int interval_tree_overlap_query_r(interval_tree_t* me, const range_t *r, void **buf, int capacity)
+{
+  struct _query_buffer_t b = { buf, capacity, 0 };
+  int ncoincidences = 0;
+
+  __interval_tree_overlap(me, __tree_root(me), r->inf, r->sup, __buffer_visitor, &b, &ncoincidences);
+  STATS_QUERY(me, 1);
+  return ncoincidences;
+}
+
+int interval_tree_overlap_query_cb(interval_tree_t* me, const range_t *r, interval_tree_visitor_t visitor, void *user)
+{
+  int ncoincidences = 0;
+
+  __interval_tree_overlap(me, __tree_root(me), r->inf, r->sup, visitor, user, &ncoincidences);
+  STATS_QUERY(me, 1);
+  return ncoincidences;
+}
+
+struct _query_first_t {
+  range_t *match;
+  void **v;
+};
+
+static int __first_visitor(const range_t *r, void *v, void *user)
+{
+  struct _query_first_t *f = (struct _query_first_t *)user;
+
+  if (f->match)
+    *f->match = *r;
+  if (f->v)
+    *f->v = v;
+  return 1;
+}
+
+int interval_tree_overlap_any(interval_tree_t* me, const range_t *r, range_t *match, void **v)
+{
+  struct _query_first_t f = { match, v };
+  int ncoincidences = 0;
+
+  __interval_tree_overlap(me, __tree_root(me), r->inf, r->sup, __first_visitor, &f, &ncoincidences);
+  STATS_QUERY(me, 1);
+  return ncoincidences;
+}
+
+/* Narrowest range of the subtree that contains k and is narrower than *best. The ranges are
+ * visited by decreasing lower limit: a range that contains k is at least as wide as the
+ * distance from its lower limit to k, so once a match of width w has been found the ranges
+ * that start before k - w are not visited. */
+static void __interval_tree_narrowest(interval_tree_t* me, int idx, interval_key_t k, interval_node_t **best)
+{
+  interval_node_t *n;
+  interval_width_t width;
+
+  n = __node_at(me, idx);
+  if (n == NULL) {
+    return;
+  }
+  STATS_VISIT();
+
+  // No range of the subtree contains k or all of them are as wide as the best match
+  width = *best ? __range_width(&(*best)->range) : (interval_width_t) -1;
+  if (n->max < k || n->min > k || (*best && n->min_width >= width)) {
+    return;
+  }
+
+  // Every range of the right subtree starts after the root's interval
+  if (n->range.inf <= k) {
+    __interval_tree_narrowest(me, __tree_right(me, idx), k, best);
+    width = *best ? __range_width(&(*best)->range) : (interval_width_t) -1;
+  }
+  if (n->range.inf <= k && n->range.sup >= k && (!*best || __range_width(&n->range) < width)) {
+    *best = n;
+    width = __range_width(&n->range);
+  }
+  // The ranges of the left subtree start before the root's interval
+  if (*best && n->range.inf <= k && (interval_width_t) k - (interval_width_t) n->range.inf >= width)
+    return;
+  __interval_tree_narrowest(me, __tree_left(me, idx), k, best);
+}
+
+int interval_tree_narrowest_query(interval_tree_t* me, interval_key_t k, range_t *match, void **v)
+{
+  interval_node_t *best = NULL;
+
+  __interval_tree_narrowest(me, __tree_root(me), k, &best);
+  STATS_QUERY(me, 1);
+  if (!best)
+    return 0;
+  if (match)
+    *match = best->range;
+  if (v)
+    *v = best->v;
+  return 1;
+}
+
+/* Ranges of the subtree that contain k */
+static int __interval_tree_count(interval_tree_t* me, int idx, interval_key_t k)
+{
+  interval_node_t *n;
+  int ncoincidences;
+
+  n = __node_at(me, idx);
+  if (n == NULL) {
+    return 0;
+  }
+  STATS_VISIT();
+
+  // None of the ranges of the subtree contains k
+  if (n->max < k || n->min > k) {
+    return 0;
+  }
+  // All of them contain k: they start before it and end after it
+  if (n->max_inf <= k && n->min_sup >= k) {
+    return n->ranges;
+  }
+
+  ncoincidences = n->range.inf <= k && n->range.sup >= k;
+  ncoincidences += __interval_tree_count(me, __tree_left(me, idx), k);
+  // Every range of the right subtree starts after the root's interval
+  if (n->range.inf <= k)
+    ncoincidences += __interval_tree_count(me, __tree_right(me, idx), k);
+  return ncoincidences;
+}
+
+int interval_tree_count(interval_tree_t* me, interval_key_t k)
+{
+  int ncoincidences;
+
+  ncoincidences = __interval_tree_count(me, __tree_root(me), k);
+  STATS_QUERY(me, 1);
+  return ncoincidences;
+}
+
+static inline int __subtree_ranges(interval_tree_t* me, int idx)
+{
+  interval_node_t *n = __node_at(me, idx);
+
+  return n ? n->ranges : 0;
+}
+
+int interval_tree_rank(interval_tree_t* me, interval_key_t k)
+{
+  interval_node_t *n;
+  int idx = __tree_root(me), rank = 0;
+
+  // Same descent as interval_tree_iterator_seek, adding the ranges left behind
+  while ((n = __node_at(me, idx))) {
+    STATS_VISIT();
+    if (n->range.inf >= k) {
+      idx = __tree_left(me, idx);
+    } else {
+      rank += __subtree_ranges(me, __tree_left(me, idx)) + 1;
+      idx = __tree_right(me, idx);
+    }
+  }
+  STATS_QUERY(me, 1);
+  return rank;
+}
+
+int interval_tree_select(interval_tree_t* me, int k, range_t *r, void **v)
+{
+  interval_node_t *n;
+  int idx = __tree_root(me), left;
+
+  if (k < 0)
+    return 0;
+  while ((n = __node_at(me, idx))) {
+    STATS_VISIT();
+    left = __subtree_ranges(me, __tree_left(me, idx));
+    if (k < left) {
+      idx = __tree_left(me, idx);
+    } else if (k == left) {
+      if (r)
+        *r = n->range;
+      if (v)
+        *v = n->v;
+      STATS_QUERY(me, 1);
+      return 1;
+    } else {
+      k -= left + 1;
+      idx = __tree_right(me, idx);
+    }
+  }
+  STATS_QUERY(me, 1);
+  return 0;
+}
+
+void interval_tree_iterator_init(interval_tree_t* me, interval_tree_iterator_t *it)
+{
+  int idx;
+
+  it->tree = me;
+  it->depth = 0;
+  for (idx = __tree_root(me); __node_at(me, idx); idx = __tree_left(me, idx)) {
+    assert(it->depth < INTERVAL_TREE_MAX_DEPTH);
+    it->stack[it->depth++] = idx;
+  }
+}
+
+void interval_tree_iterator_seek(interval_tree_t* me, interval_tree_iterator_t *it, interval_key_t k)
+{
+  interval_node_t *n;
+  int idx = __tree_root(me);
+
+  /* The stack keeps the nodes where the search went left: they come after the seeked key,
+   * in order from the top */
+  it->tree = me;
+  it->depth = 0;
+  while ((n = __node_at(me, idx))) {
+    if (n->range.inf >= k) {
+      assert(it->depth < INTERVAL_TREE_MAX_DEPTH);
+      it->stack[it->depth++] = idx;
+      idx = __tree_left(me, idx);
+    } else {
+      idx = __tree_right(me, idx);
+    }
+  }
+}
+
+int interval_tree_iterator_next(interval_tree_iterator_t *it, range_t *r, void **v)
+{
+  interval_tree_t* me = it->tree;
+  interval_node_t *n;
+  int idx;
+
+  if (!it->depth)
+    return 0;
+  idx = it->stack[--it->depth];
+  n = __node_at(me, idx);
+  if (r)
+    *r = n->range;
+  if (v)
+    *v = n->v;
+
+  // The successor is the leftmost node of the right subtree (or the next pending ancestor)
+  for (idx = __tree_right(me, idx); __node_at(me, idx); idx = __tree_left(me, idx)) {
+    assert(it->depth < INTERVAL_TREE_MAX_DEPTH);
+    it->stack[it->depth++] = idx;
+  }
+  return 1;
+}
+
+void interval_tree_set_coalescing(interval_tree_t* me, int enabled)
+{
+  me->coalesce = enabled;
+}
+
+struct _coalesce_t {
+  range_t hull;           /**< Union of r and the ranges found */
+  void *v;
+  range_t *found;         /**< Ranges with value v that overlap or abut the hull */
+  int nfound;
+  int size;
+  int error;              /**< found could not grow: some ranges are missing */
+};
+
+static int __coalesce_visitor(const range_t *r, void *v, void *user)
+{
+  struct _coalesce_t *c = (struct _coalesce_t *)user;
+  range_t *array_found;
+
+  if (v != c->v)
+    return 0;
+  if (c->nfound == c->size) {
+    array_found = realloc(c->found, (c->size ? c->size * 2 : 16) * sizeof(range_t));
+    if (!array_found) {
+      c->error = 1;
+      return 1;
+    }
+    c->found = array_found;
+    c->size = c->size ? c->size * 2 : 16;
+  }
+  c->found[c->nfound++] = *r;
+  return 0;
+}
+
+/* Like __coalesce_visitor, for the ranges inside the hull */
+static int __member_visitor(const range_t *r, void *v, void *user)
+{
+  struct _coalesce_t *c = (struct _coalesce_t *)user;
+
+  if (r->inf < c->hull.inf || r->sup > c->hull.sup)
+    return 0;
+  return __coalesce_visitor(r, v, user);
+}
+
+/* Node stored with exactly the limits of r, NULL if there is none */
+static interval_node_t *__find_node(interval_tree_t* me, const range_t *r)
+{
+  interval_node_t *n;
+  int idx = __tree_root(me);
+  long c;
+
+  while ((n = __node_at(me, idx))) {
+    c = cmp_range(r, &n->range);
+    if (!c)
+      return n;
+    idx = c > 0 ? __tree_left(me, idx) : __tree_right(me, idx);
+  }
+  return NULL;
+}
+
+/* Ranges of the absorbed tree that the merged range hull covers, in c->found. Two merged ranges
+ * with the same value never overlap, so they are the ones that it absorbed. One with the limits
+ * of the hull means that the hull itself was also inserted. */
+static int __members(interval_tree_t* me, const range_t *hull, struct _coalesce_t *c)
+{
+  memset(c, 0, sizeof(struct _coalesce_t));
+  c->hull = *hull;
+  c->v = __find_node(me, hull)->v;
+  interval_tree_overlap_query_cb(me->absorbed, hull, __member_visitor, c);
+  return c->error ? -1 : 0;
+}
+
+/* Store again as ranges of their own the ones that the merged range hull absorbed, and remove
+ * it unless it was inserted too. The lookups do not change, and the tree is not modified if it
+ * fails. */
+static int __unmerge(interval_tree_t* me, const range_t *hull)
+{
+  struct _coalesce_t c;
+  int i, inserted = 0, ret = -1;
+
+  if (__members(me, hull, &c) || __interval_tree_free_reserve(me, c.nfound + 1) ||
+      __interval_tree_free_reserve(me->absorbed, c.nfound))
+    goto out;
+  for (i = 0; i < c.nfound; i++) {
+    if (!cmp_range(&c.found[i], &c.hull)) {
+      inserted = 1;
+    } else if (__interval_tree_add(me, &c.found[i], c.v)) {
+      while (i--) {
+        if (cmp_range(&c.found[i], &c.hull))
+          __interval_tree_delete(me, &c.found[i]);
+      }
+      goto out;
+    }
+  }
+  for (i = 0; i < c.nfound; i++)
+    __interval_tree_delete(me->absorbed, &c.found[i]);
+  if (inserted) {
+    __find_node(me, &c.hull)->merged = 0;
+    ret = 0;
+  } else {
+    ret = __interval_tree_delete(me, &c.hull);
+  }
+
+out:
+  free(c.found);
+  return ret;
+}
+
+struct _hull_t {
+  interval_tree_t *me;
+  range_t r;              /**< Absorbed range */
+  void *v;
+  range_t hull;           /**< Returned: the merged range that covers r */
+  int found;
+};
+
+static int __hull_visitor(const range_t *r, void *v, void *user)
+{
+  struct _hull_t *h = (struct _hull_t *)user;
+
+  if (v != h->v || r->inf > h->r.inf || r->sup < h->r.sup || !__find_node(h->me, r)->merged)
+    return 0;
+  h->hull = *r;
+  h->found = 1;
+  return 1;
+}
+
+/* The entry a of the absorbed tree is replaced or removed: unmerge the range that absorbed it */
+static int __unmerge_absorbed(interval_tree_t* me, interval_node_t *a)
+{
+  struct _hull_t h;
+
+  memset(&h, 0, sizeof(struct _hull_t));
+  h.me = me;
+  h.r = a->range;
+  h.v = a->v;
+  interval_tree_overlap_query_cb(me, &h.r, __hull_visitor, &h);
+  assert(h.found);
+  return __unmerge(me, &h.hull);
+}
+
+/* Remove the merged range r, and forget the ranges that it absorbed */
+static int __remove_merged(interval_tree_t* me, range_t *r)
+{
+  struct _coalesce_t c;
+  int i, ret = -1;
+
+  if (!__members(me, r, &c) && !__interval_tree_free_reserve(me->absorbed, c.nfound) &&
+      !(ret = __interval_tree_delete(me, r))) {
+    for (i = 0; i < c.nfound; i++)
+      __interval_tree_delete(me->absorbed, &c.found[i]);
+  }
+  free(c.found);
+  return ret;
+}
+
+int interval_tree_insert(interval_tree_t* me, range_t *r, void *v)
+{
+  interval_node_t *n;
+
+  assert(!me->map); // Trees mapped from a snapshot are read-only
+  /* r replaces the range with its limits. If a merge absorbed that range, or that range is a
+   * merged one, the ranges that the merge covered are stored again so they are not replaced */
+  if (me->absorbed) {
+    n = __find_node(me->absorbed, r);
+    if (n && n->v == v)
+      return 0; // The merged range that absorbed it already has the same lookups
+    if (n && __unmerge_absorbed(me, n))
+      return -1;
+    n = __find_node(me, r);
+    if (n && n->merged && n->v == v)
+      return __interval_tree_add(me->absorbed, r, v); // Recorded as inserted, the lookups are the same
+    if (n && n->merged && __unmerge(me, r))
+      return -1;
+  }
+  if (me->coalesce)
+    return __interval_tree_coalesce(me, r, v);
+  return __interval_tree_add(me, r, v);
+}
+
+int interval_tree_remove(interval_tree_t* me, range_t *r)
+{
+  interval_node_t *n;
+
+  assert(!me->map); // Trees mapped from a snapshot are read-only
+  if (me->absorbed) {
+    n = __find_node(me->absorbed, r);
+    if (n && __unmerge_absorbed(me, n))
+      return -1;
+    n = __find_node(me, r);
+    if (n && n->merged)
+      return __remove_merged(me, r);
+  }
+  return __interval_tree_delete(me, r);
+}
+
+int __interval_tree_coalesce(interval_tree_t* me, range_t *r, void *v)
+{
+  struct _coalesce_t c = { *r, v, NULL, 0, 0, 0 };
+  interval_node_t *n;
+  range_t around, prev, tmp;
+  int i, j, nabsorbed, replaced, ret = -1;
+
+  /* Grow the hull until no other range with the same value touches it */
+  do {
+    prev = c.hull;
+    c.nfound = 0;
+    around.inf = c.hull.inf == INTERVAL_KEY_MIN ? c.hull.inf : c.hull.inf - 1;
+    around.sup = c.hull.sup == INTERVAL_KEY_MAX ? c.hull.sup : c.hull.sup + 1;
+    interval_tree_overlap_query_cb(me, &around, __coalesce_visitor, &c);
+    if (c.error) { // Without every range of the hull, r is inserted as it is
+      free(c.found);
+      return __interval_tree_add(me, r, v);
+    }
+    for (i = 0; i < c.nfound; i++) {
+      if (c.found[i].inf < c.hull.inf) c.hull.inf = c.found[i].inf;
+      if (c.found[i].sup > c.hull.sup) c.hull.sup = c.found[i].sup;
+    }
+  } while (c.hull.inf != prev.inf || c.hull.sup != prev.sup);
+
+  /* Nothing to merge: r only replaces the range with its limits */
+  for (i = 0, j = 0; i < c.nfound; i++)
+    j += cmp_range(&c.found[i], &c.hull) != 0;
+  if (!j && !cmp_range(r, &c.hull)) {
+    free(c.found);
+    return __interval_tree_add(me, r, v);
+  }
+
+  /* A range with other value and the limits of the hull would be overwritten, and an absorbed
+   * one could not be told apart from it: do not merge */
+  n = __find_node(me, &c.hull);
+  if ((n && n->v != v) || (me->absorbed && (n = __find_node(me->absorbed, &c.hull)) && n->v != v)) {
+    free(c.found);
+    return __interval_tree_add(me, r, v);
+  }
+
+  /* r and the ranges found that are not merged ones (they go first) are kept in the absorbed
+   * tree, the merged ones already keep theirs. As any insertion, r replaces the range with its
+   * limits and other value. */
+  for (i = 0, nabsorbed = 0; i < c.nfound; i++) {
+    if (!__find_node(me, &c.found[i])->merged) {
+      tmp = c.found[nabsorbed];
+      c.found[nabsorbed++] = c.found[i];
+      c.found[i] = tmp;
+    }
+  }
+  n = __find_node(me, r);
+  replaced = n && n->v != v;
+
+  if (!me->absorbed && !(me->absorbed = interval_tree_new_with_allocator(nabsorbed + 1, &me->allocator)))
+    goto out;
+  if (__interval_tree_free_reserve(me->absorbed, nabsorbed + 1) || __interval_tree_free_reserve(me, c.nfound + 1))
+    goto out;
+
+  /* The absorbed ranges and the hull go in first, so the tree is not modified if one of them
+   * cannot be inserted. Then the ranges that the hull covers are removed. */
+  i = 0;
+  if (__interval_tree_add(me->absorbed, r, v))
+    goto out;
+  for (; i < nabsorbed; i++) {
+    if (__interval_tree_add(me->absorbed, &c.found[i], v))
+      goto undo;
+  }
+  if (__interval_tree_add(me, &c.hull, v))
+    goto undo;
+  __find_node(me, &c.hull)->merged = 1;
+  for (i = 0; i < c.nfound; i++) {
+    if (cmp_range(&c.found[i], &c.hull))
+      __interval_tree_delete(me, &c.found[i]);
+  }
+  if (replaced)
+    __interval_tree_delete(me, r);
+  ret = 0;
+  goto out;
+
+undo:
+  while (i--)
+    __interval_tree_delete(me->absorbed, &c.found[i]);
+  __interval_tree_delete(me->absorbed, r);
+out:
+  free(c.found);
+  return ret;
+}
+
+struct _compact_entry_t {
+  range_t range;
+  void *v;
+  int group;              /**< Ranges with the same value that are merged */
+  int merged;             /**< It is a merged range: the ranges that it covers are absorbed */
+};
+
+struct _compact_group_t {
+  range_t hull;
+  int first, last;        /**< Entries [first, last) that it covers */
+  int split;              /**< Its hull collides with other range: the entries are kept */
+};
+
+static int cmp_compact_value(const void *e1, const void *e2)
+{
+  const struct _compact_entry_t *a = e1, *b = e2;
+  long r;
+
+  if (a->v != b->v)
+    return (uintptr_t) a->v < (uintptr_t) b->v ? -1 : 1;
+  r = cmp_range(&b->range, &a->range);
+  return r > 0 ? 1 : r < 0 ? -1 : 0;
+}
+
+static int cmp_compact_range(const void *e1, const void *e2)
+{
+  const struct _compact_entry_t *a = e1, *b = e2;
+  long r = cmp_range(&b->range, &a->range);
+
+  return r > 0 ? 1 : r < 0 ? -1 : 0;
+}
+
+int interval_tree_compact(interval_tree_t* me)
+{
+  struct _compact_entry_t *entries, *out;
+  struct _compact_group_t *groups;
+  interval_tree_iterator_t it;
+  interval_tree_t *fresh = NULL;
+  range_t *ranges;
+  void **values;
+  int i, j, n = me->count, ngroups = 0, nout, nabsorbed, collisions, ret = -1;
+
+  assert(!me->map); // Trees mapped from a snapshot are read-only
+  entries = malloc((n > 0 ? n : 1) * sizeof(struct _compact_entry_t));
+  out = malloc((n > 0 ? n : 1) * sizeof(struct _compact_entry_t));
+  groups = malloc((n > 0 ? n : 1) * sizeof(struct _compact_group_t));
+  ranges = malloc((n > 0 ? n : 1) * sizeof(range_t));
+  values = malloc((n > 0 ? n : 1) * sizeof(void *));
+  if (!entries || !out || !groups || !ranges || !values)
+    goto out;
+
+  interval_tree_iterator_init(me, &it);
+  for (i = 0; i < n && interval_tree_iterator_next(&it, &entries[i].range, &entries[i].v); i++)
+    entries[i].merged = __find_node(me, &entries[i].range)->merged;
+
+  /* Ranges of the same value by lower limit: each group is a run of overlapping or abutting ones */
+  qsort(entries, n, sizeof(struct _compact_entry_t), cmp_compact_value);
+  for (i = 0; i < n; i++) {
+    struct _compact_group_t *g = ngroups ? &groups[ngroups - 1] : NULL;
+
+    if (g && entries[g->first].v == entries[i].v &&
+        (entries[i].range.inf <= g->hull.sup || (g->hull.sup != INTERVAL_KEY_MAX && entries[i].range.inf == g->hull.sup + 1))) {
+      if (entries[i].range.sup > g->hull.sup)
+        g->hull.sup = entries[i].range.sup;
+      g->last = i + 1;
+    } else {
+      g = &groups[ngroups++];
+      g->hull = entries[i].range;
+      g->first = i;
+      g->last = i + 1;
+      g->split = 0;
+    }
+    entries[i].group = g - groups;
+  }
+
+  /* A merged range cannot have the limits of a range with other value that is absorbed, either
+   * now (it is in the tree) or before */
+  for (i = 0; i < ngroups; i++) {
+    interval_node_t *a;
+    void *v = entries[groups[i].first].v;
+
+    if (groups[i].last - groups[i].first > 1 &&
+        (((a = __find_node(me, &groups[i].hull)) && a->v != v) ||
+         (me->absorbed && (a = __find_node(me->absorbed, &groups[i].hull)) && a->v != v)))
+      groups[i].split = 1;
+  }
+
+  /* A merged range can have the limits of a range with other value, which the tree cannot hold
+   * twice. Those groups keep their original ranges, which can collide again with others. */
+  do {
+    for (i = 0, nout = 0; i < ngroups; i++) {
+      if (groups[i].split || groups[i].last - groups[i].first == 1) {
+        for (j = groups[i].first; j < groups[i].last; j++)
+          out[nout++] = entries[j];
+      } else {
+        out[nout].range = groups[i].hull;
+        out[nout].v = entries[groups[i].first].v;
+        out[nout].merged = 1;
+        out[nout++].group = i;
+      }
+    }
+    qsort(out, nout, sizeof(struct _compact_entry_t), cmp_compact_range);
+    for (i = 1, collisions = 0; i < nout; i++) {
+      if (cmp_range(&out[i - 1].range, &out[i].range))
+        continue;
+      for (j = i - 1; j <= i; j++) {
+        if (!groups[out[j].group].split && groups[out[j].group].last - groups[out[j].group].first > 1) {
+          groups[out[j].group].split = 1;
+          collisions++;
+        }
+      }
+    }
+  } while (collisions);
+
+  for (i = 0; i < nout; i++) {
+    ranges[i] = out[i].range;
+    values[i] = out[i].v;
+  }
+  fresh = __interval_tree_build_sorted(ranges, values, nout, 1, &me->allocator);
+  if (!fresh)
+    goto out;
+
+  /* The ranges covered by a new merged range are kept in the absorbed tree, as the coalescing
+   * mode of interval_tree_insert does */
+  for (i = 0, nabsorbed = 0; i < ngroups; i++) {
+    if (groups[i].split || groups[i].last - groups[i].first == 1)
+      continue;
+    for (j = groups[i].first; j < groups[i].last; j++) {
+      if (!entries[j].merged) {
+        ranges[nabsorbed] = entries[j].range;
+        values[nabsorbed++] = entries[j].v;
+      }
+    }
+  }
+  if (nabsorbed) {
+    if (!me->absorbed && !(me->absorbed = interval_tree_new_with_allocator(nabsorbed, &me->allocator)))
+      goto out;
+    if (__interval_tree_free_reserve(me->absorbed, nabsorbed))
+      goto out;
+    for (i = 0; i < nabsorbed; i++) {
+      if (__interval_tree_add(me->absorbed, &ranges[i], values[i])) {
+        while (i--)
+          __interval_tree_delete(me->absorbed, &ranges[i]);
+        goto out;
+      }
+    }
+  }
+
+  __interval_tree_swap(me, fresh);
+  me->coalesce = fresh->coalesce;
+  me->absorbed = fresh->absorbed;
+  fresh->absorbed = NULL;
+  for (i = 0; i < nout; i++) {
+    if (out[i].merged)
+      __find_node(me, &out[i].range)->merged = 1;
+  }
+  me->generation = fresh->generation + 1;
+#ifdef INTERVAL_TREE_STATS
+  me->stats = fresh->stats;
+#endif
+  ret = n - nout;
+
+out:
+  interval_tree_free(fresh);
+  free(entries);
+  free(out);
+  free(groups);
+  free(ranges);
+  free(values);
+  return ret;
+}
+
+size_t interval_tree_memory(interval_tree_t* me)
+{
+  size_t bytes = sizeof(interval_tree_t) + (me->size + 1) * sizeof(void *);
+
+  if (me->map)
+    return bytes + me->map_size;
+  bytes += me->size * sizeof(interval_node_t) + me->perm_size * sizeof(int) + me->free_size * sizeof(int);
+  if (me->tree)
+    bytes += sizeof(avltree_t) + me->tree->size * sizeof(node_t);
+  if (me->absorbed)
+    bytes += interval_tree_memory(me->absorbed);
+  return bytes;
+}
+
+static void __depth_histogram(interval_tree_t* me, int idx, int d, interval_tree_stats_t *stats)
+{
+  if (!__node_at(me, idx) || d >= INTERVAL_TREE_MAX_DEPTH)
+    return;
+  stats->depth_histogram[d]++;
+  if (d + 1 > stats->height)
+    stats->height = d + 1;
+  __depth_histogram(me, __tree_left(me, idx), d + 1, stats);
+  __depth_histogram(me, __tree_right(me, idx), d + 1, stats);
+}
+
+void interval_tree_stats(interval_tree_t* me, interval_tree_stats_t *stats)
+{
+  memset(stats, 0, sizeof(interval_tree_stats_t));
+  stats->count = me->count;
+  __depth_histogram(me, __tree_root(me), 0, stats);
+
+#ifdef INTERVAL_TREE_POOL
+  stats->array_size = me->size;
+#else
+  stats->array_size = me->tree ? me->tree->size : me->perm_size;
+#endif
+  stats->fill_ratio = stats->array_size ? (double) me->count / stats->array_size : 0;
+  stats->nodes_bytes = me->size * sizeof(interval_node_t);
+  stats->perm_bytes = me->perm_size * sizeof(int);
+  stats->multiple_query_bytes = (me->size + 1) * sizeof(void *);
+  stats->avl_bytes = me->tree ? me->tree->size * sizeof(node_t) : 0;
+  stats->total_bytes = interval_tree_memory(me);
+
+#ifdef INTERVAL_TREE_STATS
+  stats->counters_enabled = 1;
+  stats->queries = __atomic_load_n(&me->stats.queries, __ATOMIC_RELAXED);
+  stats->nodes_visited = __atomic_load_n(&me->stats.nodes_visited, __ATOMIC_RELAXED);
+  stats->rotations = me->stats.rotations;
+  stats->shift_up = me->stats.shift_up;
+  stats->shift_down = me->stats.shift_down;
+  stats->enlargements = me->stats.enlargements;
+  stats->bytes_copied = me->stats.bytes_copied;
+  if (me->tree) {
+    stats->rotations += me->tree->rotations;
+    stats->enlargements += me->tree->enlargements;
+    stats->bytes_copied += me->tree->bytes_copied;
+  }
+#endif
+}
+
+void interval_tree_stats_reset(interval_tree_t* me)
+{
+#ifdef INTERVAL_TREE_STATS
+  memset(&me->stats, 0, sizeof(me->stats));
+  if (me->tree) {
+    me->tree->rotations = 0;
+    me->tree->enlargements = 0;
+    me->tree->bytes_copied = 0;
+  }
+#else
+  (void) me;
+#endif
+}
+
+void interval_tree_stats_print(interval_tree_t* me)
+{
+  interval_tree_stats_t stats;
+  int i;
+
+  interval_tree_stats(me, &stats);
+  printf("Ranges: %d. Height: %d. Array positions: %d (fill ratio %.3f)\n",
+         stats.count, stats.height, stats.array_size, stats.fill_ratio);
+  printf("Depth histogram:\n");
+  for (i = 0; i < stats.height; i++) {
+    printf("  %2d: %d\n", i, stats.depth_histogram[i]);
+  }
+  printf("Memory: %zu bytes (nodes %zu, nodes_perm %zu, multiple_query_return %zu, AVL array %zu)\n",
+         stats.total_bytes, stats.nodes_bytes, stats.perm_bytes, stats.multiple_query_bytes, stats.avl_bytes);
+  if (!stats.counters_enabled) {
+    printf("Counters: not compiled (INTERVAL_TREE_STATS)\n");
+    return;
+  }
+  printf("Queries: %" PRIu64 " (%.2f nodes visited per query)\n", stats.queries,
+         stats.queries ? (double) stats.nodes_visited / stats.queries : 0);
+  printf("Rotations: %" PRIu64 ". Shifts: %" PRIu64 " up, %" PRIu64 " down\n",
+         stats.rotations, stats.shift_up, stats.shift_down);
+  printf("Enlargements: %" PRIu64 " (%" PRIu64 " bytes copied)\n", stats.enlargements, stats.bytes_copied);
+}
+
+static void __print_key(interval_key_t k)
+{
+#ifdef INTERVAL_TREE_KEY128
+  uint64_t hi = (uint64_t)(k >> 64), lo = (uint64_t) k;
+
+  if (hi)
+    printf("0x%" PRIx64 "%016" PRIx64, hi, lo);
+  else
+    printf("0x%" PRIx64, lo);
+#else
+  printf("%" PRId64, k);
+#endif
+}
+
+static void __print(interval_tree_t* me, int idx, int d, char side)
 {
+  interval_node_t *n;
   int i;
 
   for (i = 0; i < d; i++)
     printf(" ");
-  printf("%c: ", idx % 2 == 1 ? 'l' : 'r');
+  printf("%c: ", side);
 
-  if (me->size <= idx || !avltree_get_from_idx(me->tree, idx) || !(&(me->nodes[me->nodes_perm[i]].range))) {
+  if (!(n = __node_at(me, idx))) {
     printf("-\n");
     return;
   }
 
-  printf("Range [%ld-%ld]. Max %ld Min %ld\n", me->nodes[me->nodes_perm[idx]].range.inf, me->nodes[me->nodes_perm[idx]].range.sup, me->nodes[me->nodes_perm[idx]].max, me->nodes[me->nodes_perm[idx]].min);
-  __print(me, __child_l(idx), d + 1);
-  __print(me, __child_r(idx), d + 1);
+  printf("Range [");
+  __print_key(n->range.inf);
+  printf("-");
+  __print_key(n->range.sup);
+  printf("]. Max ");
+  __print_key(n->max);
+  printf(" Min ");
+  __print_key(n->min);
+  printf("\n");
+  __print(me, __tree_left(me, idx), d + 1, 'l');
+  __print(me, __tree_right(me, idx), d + 1, 'r');
 }
 
 void interval_tree_print(interval_tree_t* me)
 {
-  __print(me, 0, 0);
+  __print(me, __tree_root(me), 0, 'r');
 }
@@ -1,8 +1,6 @@
 /**
  * @file interval_tree.h
  * Implementation of basic interval trees using an AVL implementation.
- * This initial version does not support the possibility of removing
- * nodes.
  *
  * Implemented over an array, so memory access is optimal
  *
@@ -12,15 +10,37 @@
 #ifndef INTERVAL_TREE_H
 #define INTERVAL_TREE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef struct _interval_tree_t interval_tree_t; /**< Opaque structure of the tree */
 
+/**
+ * @brief Type of the limits of the ranges and of the searched keys. By default it is a signed
+ * 64 bit integer. Compiling with INTERVAL_TREE_KEY128 defined (make KEY128=1) makes it an
+ * unsigned 128 bit integer, so an IPv6 address can be looked up in a single descent.
+ * The whole program must be compiled with the same definition.
+ */
+#ifdef INTERVAL_TREE_KEY128
+typedef unsigned __int128 interval_key_t;
+#define INTERVAL_KEY_MIN ((interval_key_t) 0)
+#define INTERVAL_KEY_MAX (~(interval_key_t) 0)
+#else
+typedef int64_t interval_key_t;
+#define INTERVAL_KEY_MIN INT64_MIN
+#define INTERVAL_KEY_MAX INT64_MAX
+#endif
+
 /**
  * @brief Structure defining a close range [a,b].
  */
 struct _range_t {
-  int64_t inf; /**< Lower limit */
-  int64_t sup; /**< Upper limit */
+  interval_key_t inf; /**< Lower limit */
+  interval_key_t sup; /**< Upper limit */
 };
 typedef struct _range_t range_t;
 
@@ -34,6 +54,74 @@ typedef struct _range_t range_t;
  */
 interval_tree_t* interval_tree_new(int initial_size);
 
+/**
+ * @brief Source of the memory of a tree: its arrays (nodes, positions, buffers) and the structure
+ * itself. It lets a tree live in a pre-faulted arena or in a region of huge pages, which avoids
+ * page faults and TLB misses on lookups. The callbacks are called with ctx, from the thread that
+ * creates or modifies the tree (interval_tree_new_with_allocator, interval_tree_insert,
+ * interval_tree_remove, interval_tree_reserve, interval_tree_compact, interval_tree_free), never
+ * from a query.
+ */
+struct _interval_tree_allocator_t {
+  void *(*allocate)(size_t size, void *ctx);  /**< Like malloc: the tree initializes the memory itself */
+  void *(*reallocate)(void *ptr, size_t old_size, size_t size, void *ctx); /**< Like realloc. If it is
+                                                   NULL, allocate, copy and release are used */
+  void (*release)(void *ptr, size_t size, void *ctx); /**< Like free, with the size that was requested */
+  void *ctx;                                   /**< Passed to every callback */
+};
+typedef struct _interval_tree_allocator_t interval_tree_allocator_t;
+
+/**
+ * @brief interval_tree_new that takes all the memory of the tree from an allocator.
+ *
+ * @param initial_size Initial array size.
+ * @param allocator Copied into the tree, so it does not need to outlive the call (ctx does).
+ * NULL is equivalent to interval_tree_new.
+ * @return NULL if the tree could not be generated.
+ */
+interval_tree_t* interval_tree_new_with_allocator(int initial_size, const interval_tree_allocator_t *allocator);
+
+/**
+ * @brief Size every array of the tree for n ranges at once, so the insertions and removals that
+ * keep it within n ranges do not reallocate and copy them. The array of the default backend
+ * holds whole levels of the AVL tree, and it is reserved for a tree two levels deeper than a
+ * perfectly balanced one: large sets inserted in random order can still make it grow (the
+ * pool backend, make BACKEND=pool, has no such limit).
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param n Number of ranges.
+ * @return 0 on success, -1 if the memory could not be allocated or the tree is mapped from a
+ * snapshot.
+ */
+int interval_tree_reserve(interval_tree_t* me, int n);
+
+/**
+ * @brief Builds a perfectly balanced interval tree from an array of ranges in a single pass.
+ * It is much faster than calling interval_tree_insert for every range: no rotation is
+ * performed and the max/min fields are computed bottom-up in O(n).
+ *
+ * @param ranges The ranges to insert. They are sorted internally (O(n) check if they are already
+ * sorted by their lower limit), the array is not modified.
+ * @param values The value of each range (values[i] belongs to ranges[i]). It can be NULL.
+ * If the same range appears several times, the last value is kept.
+ * @param n Number of elements in the arrays.
+ * @return NULL if the tree could not be generated.
+ */
+interval_tree_t* interval_tree_build(range_t *ranges, void **values, int n);
+
+/**
+ * @brief interval_tree_build for very large sets of ranges: the ranges are sorted by a
+ * parallel merge sort, and the subtrees are laid out and their max/min fields computed by
+ * different threads. The tree is the same that interval_tree_build returns.
+ *
+ * @param ranges See interval_tree_build.
+ * @param values See interval_tree_build.
+ * @param n Number of elements in the arrays.
+ * @param nthreads Maximum number of threads, including the caller.
+ * @return NULL if the tree could not be generated.
+ */
+interval_tree_t* interval_tree_build_parallel(range_t *ranges, void **values, int n, int nthreads);
+
 /**
  * @brief Free a previous allocated structure by the interval_tree_new function
  *
@@ -51,8 +139,20 @@ void interval_tree_free(interval_tree_t* me);
  *
  * @param v The value that the user will retrieve by the time that a hit is produced when
  * looking for this kind of elements.
+ * @return 0 on success, -1 if the memory could not be allocated (the tree is not modified).
  */
-void interval_tree_insert(interval_tree_t* me, struct _range_t *r, void *v);
+int interval_tree_insert(interval_tree_t* me, struct _range_t *r, void *v);
+
+/**
+ * @brief Remove a range from the tree in O(log n): the max/min fields are only recomputed
+ * along the path to the root. The entry of the node is kept for the next insertion. A range
+ * absorbed by a merge can also be removed, see interval_tree_set_coalescing.
+ *
+ * @param me A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param r The range to remove (both limits must match).
+ * @return 0 if the range was removed, -1 if it was not in the tree.
+ */
+int interval_tree_remove(interval_tree_t* me, struct _range_t *r);
 
 /**
  * @brief Given an integer, check for an occurence in a range.
@@ -62,7 +162,21 @@ void interval_tree_insert(interval_tree_t* me, struct _range_t *r, void *v);
  *
  * @return The value associated to the matched range, NULL if no occurence has appeared.
  */
-void *interval_tree_query(interval_tree_t* me, int k);
+void *interval_tree_query(interval_tree_t* me, interval_key_t k);
+
+/**
+ * @brief Look up a burst of integers. It is equivalent to calling interval_tree_query for
+ * every key, but the lookups are advanced in lockstep and the nodes of the next level are
+ * prefetched, so the memory latency of the different descents overlaps. It pays off once the
+ * tree does not fit in the cache; for small trees the scalar function is faster.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param keys The integers to search.
+ * @param n Number of keys.
+ * @param out Array of n elements. out[i] receives the value associated to the range matched by
+ * keys[i], NULL if no occurence has appeared.
+ */
+void interval_tree_query_batch(interval_tree_t* me, const interval_key_t *keys, int n, void **out);
 
 /**
  * @brief Given an integer, check for all the occurences in the ranges that conform the tree
@@ -74,8 +188,278 @@ void *interval_tree_query(interval_tree_t* me, int k);
  * For instance, if the tree is composed by the ranges [0,20] with value v1, [10.30] with value v2,
  * the return of the function will be:
  *    {v0,v1,NULL}
+ *
+ * The array belongs to the tree and is overwritten by the next call, so this function cannot
+ * be used by several threads at the same time. See interval_tree_multiple_query_r.
+ */
+void **interval_tree_multiple_query(interval_tree_t* me, interval_key_t k);
+
+/**
+ * @brief Reentrant version of interval_tree_multiple_query: the values are written in a buffer
+ * supplied by the caller. As long as no thread modifies the tree, any number of threads can
+ * query it at the same time (the same applies to interval_tree_query).
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param k The integer to search.
+ * @param buf Array that receives the values associated to the ranges that matched the key.
+ * @param capacity Number of elements of buf. The values that do not fit are not written.
+ *
+ * @return The number of ranges that matched the key. If it is greater than capacity, the
+ * output has been truncated.
+ */
+int interval_tree_multiple_query_r(interval_tree_t* me, interval_key_t k, void **buf, int capacity);
+
+/**
+ * @brief Function invoked for every range that matches a query.
+ *
+ * @param r The matched range. It must not be modified.
+ * @param v The value associated to the range.
+ * @param user The pointer given to the query function.
+ * @return 0 to continue with the search, any other value stops it.
+ */
+typedef int (*interval_tree_visitor_t)(const range_t *r, void *v, void *user);
+
+/**
+ * @brief Reentrant version of interval_tree_multiple_query that reports every match to a callback,
+ * so the search can be stopped as soon as the caller has found what it was looking for.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param k The integer to search.
+ * @param visitor The function invoked for every matched range (in the same order than
+ * interval_tree_multiple_query returns them).
+ * @param user The pointer that will be passed as a third argument to the visitor.
+ *
+ * @return The number of ranges reported to the visitor.
  */
-void **interval_tree_multiple_query(interval_tree_t* me, int k);
+int interval_tree_multiple_query_cb(interval_tree_t* me, interval_key_t k, interval_tree_visitor_t visitor, void *user);
+
+/**
+ * @brief Find the ranges that overlap [r->inf, r->sup] (they share at least one integer).
+ * Subtrees whose [min, max] range does not overlap it are pruned, so the cost is
+ * O(log n + number of matches). Same reentrancy rules than interval_tree_multiple_query_r.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param r The searched range.
+ * @param buf Array that receives the values associated to the overlapped ranges.
+ * @param capacity Number of elements of buf. The values that do not fit are not written.
+ *
+ * @return The number of ranges that overlap r. If it is greater than capacity, the
+ * output has been truncated.
+ */
+int interval_tree_overlap_query_r(interval_tree_t* me, const range_t *r, void **buf, int capacity);
+
+/**
+ * @brief Version of interval_tree_overlap_query_r that reports every overlapped range to a
+ * callback, which can stop the search.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param r The searched range.
+ * @param visitor The function invoked for every overlapped range.
+ * @param user The pointer that will be passed as a third argument to the visitor.
+ *
+ * @return The number of ranges reported to the visitor.
+ */
+int interval_tree_overlap_query_cb(interval_tree_t* me, const range_t *r, interval_tree_visitor_t visitor, void *user);
+
+/**
+ * @brief Check if any range of the tree overlaps r, stopping at the first one found.
+ * Useful to detect conflicts before inserting a new range.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param r The searched range.
+ * @param match If not NULL and there is an overlap, it receives the overlapped range.
+ * @param v If not NULL and there is an overlap, it receives the value of the overlapped range.
+ *
+ * @return 1 if some range overlaps r, 0 otherwise.
+ */
+int interval_tree_overlap_any(interval_tree_t* me, const range_t *r, range_t *match, void **v);
+
+/**
+ * @brief Find the narrowest range that contains k (the one with the fewest keys), as the
+ * longest prefix match of a routing table. Every node keeps the width of the narrowest range
+ * of its subtree, so the subtrees that cannot improve the best match found so far are pruned
+ * without visiting their ranges, and the ranges are visited by decreasing lower limit, so the
+ * ones that start too far from k to be narrower than the best match are skipped. If several
+ * ranges have the same width, the one with the greatest lower limit is returned. Same
+ * reentrancy rules than interval_tree_multiple_query_r.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param k The integer to search.
+ * @param match If not NULL and there is a match, it receives the narrowest range.
+ * @param v If not NULL and there is a match, it receives the value of the narrowest range.
+ *
+ * @return 1 if some range contains k, 0 otherwise.
+ */
+int interval_tree_narrowest_query(interval_tree_t* me, interval_key_t k, range_t *match, void **v);
+
+/**
+ * @brief Number of ranges that contain k, as interval_tree_multiple_query_r returns, but without
+ * writing their values anywhere. Every node keeps the number of ranges of its subtree and the
+ * greatest lower limit and smallest upper limit among them, so a subtree whose ranges all
+ * contain k is counted in O(1) instead of being enumerated. Same reentrancy rules than
+ * interval_tree_multiple_query_r.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param k The integer to search.
+ *
+ * @return The number of ranges that contain k.
+ */
+int interval_tree_count(interval_tree_t* me, interval_key_t k);
+
+/**
+ * @brief Number of ranges whose lower limit is smaller than k, that is, the position that
+ * interval_tree_iterator_seek(me, it, k) leaves the iterator at. Every node keeps the number
+ * of ranges of its subtree, so it is O(log n). Same reentrancy rules than interval_tree_query.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param k The key.
+ * @return The number of ranges that start before k.
+ */
+int interval_tree_rank(interval_tree_t* me, interval_key_t k);
+
+/**
+ * @brief Find the k-th range of the tree in the order of the iterators (by lower limit, then
+ * by upper limit), in O(log n). Same reentrancy rules than interval_tree_query.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param k Position of the range, starting at 0.
+ * @param r If not NULL, it receives the range.
+ * @param v If not NULL, it receives the value of the range.
+ * @return 1 if the range exists, 0 if k is negative or not smaller than the number of ranges.
+ */
+int interval_tree_select(interval_tree_t* me, int k, range_t *r, void **v);
+
+/**
+ * @brief Enable or disable the coalescing mode of interval_tree_insert. When it is enabled, a
+ * new range absorbs the ranges with the same value that overlap or abut it ([0,20] and [21,40]
+ * become [0,40]), so the tree has fewer nodes and the lookups of any key return the same values.
+ * The absorbed ranges are kept aside, out of the path of the lookups. When one of them is
+ * inserted again with another value or removed, or a range with other value is inserted with
+ * the limits of a merged one, the ranges that the merged range covers are stored again as
+ * ranges of their own first, so no inserted range is lost. Functions that report every match
+ * (interval_tree_multiple_query, interval_tree_count...) and the iterators return a merged
+ * range once, and removing it with its limits also removes the ranges that it absorbed. The
+ * merge is skipped if the resulting range would have the limits of a range with other value.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param enabled 1 to merge the inserted ranges, 0 to store them as they are (the default).
+ */
+void interval_tree_set_coalescing(interval_tree_t* me, int enabled);
+
+/**
+ * @brief Merge every group of ranges with the same value that overlap or abut, as the coalescing
+ * mode of interval_tree_insert does (the merged ranges are kept aside too), and rebuild the tree
+ * perfectly balanced with the memory that the remaining ranges need, also when no range is
+ * merged. O(n log n).
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @return The number of ranges that have been removed by the merge, -1 if the memory could not
+ * be allocated (the tree is not modified).
+ */
+int interval_tree_compact(interval_tree_t* me);
+
+/**
+ * @brief Memory used by the tree, including the space reserved for future insertions.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @return The number of bytes.
+ */
+size_t interval_tree_memory(interval_tree_t* me);
+
+#define INTERVAL_TREE_MAX_DEPTH 64 /**< Larger than the height of any AVL tree of 2^31 nodes */
+
+/**
+ * @brief Shape, memory and activity of a tree, see interval_tree_stats.
+ * The counters are only maintained when the library is compiled with INTERVAL_TREE_STATS
+ * defined (make STATS=1); otherwise they cost nothing and are reported as 0.
+ */
+struct _interval_tree_stats_t {
+  int count;                                     /**< Stored ranges */
+  int height;                                    /**< Levels of the tree */
+  int depth_histogram[INTERVAL_TREE_MAX_DEPTH];  /**< Ranges stored at every depth (root = 0) */
+  int array_size;                                /**< Positions of the implicit heap (AVL array), or
+                                                      entries of the pool with BACKEND=pool */
+  double fill_ratio;                             /**< count / array_size */
+  size_t nodes_bytes;                            /**< Array of nodes */
+  size_t perm_bytes;                             /**< Heap position -> node index */
+  size_t multiple_query_bytes;                   /**< Buffer of interval_tree_multiple_query */
+  size_t avl_bytes;                              /**< Array of the AVL tree (0 with BACKEND=pool) */
+  size_t total_bytes;                            /**< See interval_tree_memory */
+
+  int counters_enabled;                          /**< 1 if compiled with INTERVAL_TREE_STATS */
+  uint64_t queries;                              /**< Keys or ranges searched */
+  uint64_t nodes_visited;                        /**< By those queries */
+  uint64_t rotations;                            /**< Performed to rebalance the tree */
+  uint64_t shift_up;                             /**< Invocations of the shift callbacks */
+  uint64_t shift_down;
+  uint64_t enlargements;                         /**< Reallocations of the internal arrays */
+  uint64_t bytes_copied;                         /**< By those reallocations */
+};
+typedef struct _interval_tree_stats_t interval_tree_stats_t;
+
+/**
+ * @brief Collect the statistics of a tree. The shape is computed with a traversal of the
+ * tree (O(n)); the counters are the ones accumulated since the creation
+ * of the tree or the last interval_tree_stats_reset.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param stats The structure that receives the statistics.
+ */
+void interval_tree_stats(interval_tree_t* me, interval_tree_stats_t *stats);
+
+/**
+ * @brief Set the counters of the statistics to 0.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ */
+void interval_tree_stats_reset(interval_tree_t* me);
+
+/**
+ * @brief Print the statistics of the tree in a human readable way.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ */
+void interval_tree_stats_print(interval_tree_t* me);
+
+/**
+ * @brief Position of a walk over the ranges of a tree in order (by lower limit, then by upper
+ * limit). It is declared by the caller (usually in the stack): no memory is allocated. Its
+ * fields are private. Any modification of the tree invalidates it.
+ */
+struct _interval_tree_iterator_t {
+  interval_tree_t *tree;
+  int depth;                              /* Ancestors pending to be visited */
+  int stack[INTERVAL_TREE_MAX_DEPTH];
+};
+typedef struct _interval_tree_iterator_t interval_tree_iterator_t;
+
+/**
+ * @brief Place the iterator before the first range of the tree.
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param it The iterator.
+ */
+void interval_tree_iterator_init(interval_tree_t* me, interval_tree_iterator_t *it);
+
+/**
+ * @brief Place the iterator before the first range whose lower limit is not smaller than k,
+ * in O(log n).
+ *
+ * @param me  A interval tree that has been previously allocated by a call to interval_tree_new.
+ * @param it The iterator.
+ * @param k The key to seek.
+ */
+void interval_tree_iterator_seek(interval_tree_t* me, interval_tree_iterator_t *it, interval_key_t k);
+
+/**
+ * @brief Advance the iterator to the next range. Every step is O(1) amortized.
+ *
+ * @param it An iterator placed by interval_tree_iterator_init or interval_tree_iterator_seek.
+ * @param r If not NULL, it receives the range.
+ * @param v If not NULL, it receives the value of the range.
+ * @return 1 if a range has been returned, 0 if the walk is over.
+ */
+int interval_tree_iterator_next(interval_tree_iterator_t *it, range_t *r, void **v);
 
 /**
  * @brief Print the current tree in a fashionable manner.
@@ -84,4 +468,8 @@ void **interval_tree_multiple_query(interval_tree_t* me, int k);
  */
 void interval_tree_print(interval_tree_t* me);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,484 @@
+/**
+ * @file interval_tree.hpp
+ * Header-only C++ version of the interval tree.
+ *
+ * Same algorithms than the C library (an AVL tree ordered by the lower limit whose nodes keep
+ * the max/min limit of their subtree), but the key type and the comparator are template
+ * parameters, so every comparison is inlined, and the values are stored by type inside the
+ * nodes instead of being boxed in a void *. The nodes live in a dense vector linked by
+ * 32 bit indexes, as the pool backend of the C library (BACKEND=pool).
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifndef INTERVAL_TREE_HPP
+#define INTERVAL_TREE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace interval_trees {
+
+/**
+ * @brief Interval tree that maps closed ranges [inf, sup] of Key to a Value.
+ *
+ * @tparam Key Type of the limits of the ranges and of the searched keys.
+ * @tparam Value Type of the value associated to every range. It only has to be movable.
+ * @tparam Compare Strict weak order of the keys (Compare()(a, b) is true if a < b).
+ */
+template <typename Key = int64_t, typename Value = void *, typename Compare = std::less<Key> >
+class interval_tree {
+public:
+  typedef Key key_type;
+  typedef Value value_type;
+
+  /**
+   * @brief A close range [inf, sup].
+   */
+  struct range_type {
+    Key inf; /**< Lower limit */
+    Key sup; /**< Upper limit */
+  };
+
+  static const int max_depth = 64; /**< Larger than the height of any AVL tree of 2^31 nodes */
+
+  /**
+   * @brief Create an empty tree.
+   *
+   * @param initial_size Number of ranges that can be inserted before the pool is reallocated.
+   * @param cmp The comparator of the keys.
+   */
+  explicit interval_tree(size_t initial_size = 0, const Compare &cmp = Compare())
+    : root_(-1), cmp_(cmp)
+  {
+    nodes_.reserve(initial_size);
+  }
+
+  /**
+   * @brief Replace the content of the tree by a perfectly balanced tree built in O(n log n)
+   * (O(n) if the ranges are already sorted). No rotation is performed.
+   *
+   * @param items The ranges and their values. If the same range appears several times, the
+   * last value is kept.
+   */
+  void build(std::vector<std::pair<range_type, Value> > items)
+  {
+    size_t i, m;
+
+    std::stable_sort(items.begin(), items.end(), build_order(this));
+    for (i = 0, m = 0; i < items.size(); i++) {
+      if (m && equal(items[m - 1].first, items[i].first)) {
+        items[m - 1] = std::move(items[i]);
+      } else {
+        if (m != i)
+          items[m] = std::move(items[i]);
+        m++;
+      }
+    }
+
+    nodes_.clear();
+    nodes_.reserve(m);
+    build(items, (int32_t) m);
+  }
+
+  /**
+   * @brief Insert a range in the tree. It is impossible to store two nodes with the same
+   * range: the same range implies an update of the value.
+   *
+   * @param inf Lower limit of the range.
+   * @param sup Upper limit of the range.
+   * @param v The value that will be retrieved by the queries that match the range.
+   */
+  void insert(const Key &inf, const Key &sup, Value v)
+  {
+    range_type r = { inf, sup };
+
+    root_ = insert(root_, r, v);
+  }
+
+  /**
+   * @brief Remove a range from the tree in O(log n). The last node of the pool takes the
+   * place of the removed one, so the pool stays dense.
+   *
+   * @param inf Lower limit of the range.
+   * @param sup Upper limit of the range.
+   * @return true if the range was removed, false if it was not in the tree.
+   */
+  bool remove(const Key &inf, const Key &sup)
+  {
+    range_type r = { inf, sup };
+    int32_t removed = -1;
+
+    root_ = remove(root_, r, removed);
+    if (removed < 0)
+      return false;
+    compact(removed);
+    return true;
+  }
+
+  /**
+   * @brief Given a key, check for an occurence in a range.
+   *
+   * @param k The key to search.
+   * @return The value associated to a matched range, nullptr if no occurence has appeared.
+   * It is valid until the next modification of the tree.
+   */
+  const Value *query(const Key &k) const
+  {
+    int32_t pos = root_, l;
+
+    /* A single path from the root: if the left subtree reaches k (its max is not smaller)
+     * but none of its ranges contains k, every range of the right subtree starts too late. */
+    while (pos >= 0) {
+      const node &n = nodes_[pos];
+
+      if (contains(n.range, k))
+        return &n.value;
+      l = n.left;
+      if (l >= 0 && !less(nodes_[l].max, k))
+        pos = l;
+      else if (less(k, n.range.inf))
+        return nullptr;
+      else
+        pos = n.right;
+    }
+    return nullptr;
+  }
+
+  Value *query(const Key &k)
+  {
+    return const_cast<Value *>(static_cast<const interval_tree *>(this)->query(k));
+  }
+
+  /**
+   * @brief Report every range that contains k to a visitor.
+   *
+   * @param k The key to search.
+   * @param visitor Invoked as visitor(const range_type &, const Value &) for every matched
+   * range. It returns true to stop the search.
+   * @return The number of ranges reported to the visitor.
+   */
+  template <typename Visitor>
+  size_t multiple_query(const Key &k, Visitor visitor) const
+  {
+    return overlap_query(k, k, visitor);
+  }
+
+  /**
+   * @brief Report every range that overlaps [a, b] (they share at least one key) to a visitor.
+   * Subtrees whose [min, max] range does not overlap it are pruned, so the cost is
+   * O(log n + number of matches).
+   *
+   * @param a Lower limit of the searched range.
+   * @param b Upper limit of the searched range.
+   * @param visitor Invoked as visitor(const range_type &, const Value &) for every overlapped
+   * range. It returns true to stop the search.
+   * @return The number of ranges reported to the visitor.
+   */
+  template <typename Visitor>
+  size_t overlap_query(const Key &a, const Key &b, Visitor visitor) const
+  {
+    size_t ncoincidences = 0;
+
+    overlap(root_, a, b, visitor, ncoincidences);
+    return ncoincidences;
+  }
+
+  /**
+   * @brief Check if any range overlaps [a, b], stopping at the first one found.
+   *
+   * @param a Lower limit of the searched range.
+   * @param b Upper limit of the searched range.
+   * @return The value of an overlapped range, nullptr if there is none.
+   */
+  const Value *overlap_any(const Key &a, const Key &b) const
+  {
+    const Value *found = nullptr;
+
+    overlap_query(a, b, [&found](const range_type &, const Value &v) {
+      found = &v;
+      return true;
+    });
+    return found;
+  }
+
+  size_t size() const { return nodes_.size(); }   /**< Stored ranges */
+  bool empty() const { return nodes_.empty(); }
+
+  /**
+   * @brief Reserve space for n ranges, so the next insertions do not reallocate the pool.
+   */
+  void reserve(size_t n) { nodes_.reserve(n); }
+
+  void clear()
+  {
+    nodes_.clear();
+    root_ = -1;
+  }
+
+  /**
+   * @brief Memory used by the tree, including the space reserved for future insertions
+   * (but not the memory owned by the values).
+   */
+  size_t memory() const { return sizeof(*this) + nodes_.capacity() * sizeof(node); }
+
+  /**
+   * @brief Levels of the tree.
+   */
+  int height() const { return height(root_); }
+
+private:
+  /* The fields read by query come first, so they share a cache line more often */
+  struct node {
+    range_type range;
+    Key max;
+    int32_t left;    /* Index of the children in nodes_ (-1 if there is none) */
+    int32_t right;
+    Key min;
+    int32_t height;  /* Of the subtree rooted at this node (1 for a leaf) */
+    Value value;
+
+    node(const range_type &r, Value &&v)
+      : range(r), max(r.sup), left(-1), right(-1), min(r.inf), height(1), value(std::move(v)) {}
+  };
+
+  struct build_order {
+    const interval_tree *me;
+    explicit build_order(const interval_tree *t) : me(t) {}
+    bool operator()(const std::pair<range_type, Value> &a, const std::pair<range_type, Value> &b) const
+    {
+      return me->before(a.first, b.first);
+    }
+  };
+
+  bool less(const Key &a, const Key &b) const { return cmp_(a, b); }
+
+  /* Order of the ranges: smaller lower limit, then smaller upper limit */
+  bool before(const range_type &a, const range_type &b) const
+  {
+    return less(a.inf, b.inf) || (!less(b.inf, a.inf) && less(a.sup, b.sup));
+  }
+
+  bool equal(const range_type &a, const range_type &b) const
+  {
+    return !before(a, b) && !before(b, a);
+  }
+
+  bool contains(const range_type &r, const Key &k) const
+  {
+    return !less(k, r.inf) && !less(r.sup, k);
+  }
+
+  int height(int32_t pos) const { return pos < 0 ? 0 : nodes_[pos].height; }
+
+  /* The children of pos changed: recompute its height and its max/min fields */
+  void update(int32_t pos)
+  {
+    node &n = nodes_[pos];
+
+    n.height = 1 + std::max(height(n.left), height(n.right));
+    n.max = n.range.sup;
+    n.min = n.range.inf;
+    if (n.left >= 0) {
+      if (less(n.max, nodes_[n.left].max)) n.max = nodes_[n.left].max;
+      if (less(nodes_[n.left].min, n.min)) n.min = nodes_[n.left].min;
+    }
+    if (n.right >= 0) {
+      if (less(n.max, nodes_[n.right].max)) n.max = nodes_[n.right].max;
+      if (less(nodes_[n.right].min, n.min)) n.min = nodes_[n.right].min;
+    }
+  }
+
+  int32_t rotate_left(int32_t pos)
+  {
+    int32_t r = nodes_[pos].right;
+
+    nodes_[pos].right = nodes_[r].left;
+    nodes_[r].left = pos;
+    update(pos);
+    update(r);
+    return r;
+  }
+
+  int32_t rotate_right(int32_t pos)
+  {
+    int32_t l = nodes_[pos].left;
+
+    nodes_[pos].left = nodes_[l].right;
+    nodes_[l].right = pos;
+    update(pos);
+    update(l);
+    return l;
+  }
+
+  /* Restore the AVL property of the subtree rooted at pos, whose children are balanced.
+   * Returns the new root of the subtree. */
+  int32_t balance(int32_t pos)
+  {
+    node &n = nodes_[pos];
+    int bf = height(n.left) - height(n.right);
+
+    if (bf > 1) {
+      if (height(nodes_[n.left].left) < height(nodes_[n.left].right))
+        n.left = rotate_left(n.left);
+      return rotate_right(pos);
+    }
+    if (bf < -1) {
+      if (height(nodes_[n.right].right) < height(nodes_[n.right].left))
+        n.right = rotate_right(n.right);
+      return rotate_left(pos);
+    }
+    update(pos);
+    return pos;
+  }
+
+  /* Lay out the nodes level by level, as the implicit heap of the C library: the top of the
+   * tree, which every search walks, is packed in a few cache lines */
+  void build(std::vector<std::pair<range_type, Value> > &items, int32_t n)
+  {
+    std::vector<std::pair<int32_t, int32_t> > spans; // Ranges of items of every node
+    int32_t i, lo, hi, mid;
+
+    root_ = n ? 0 : -1;
+    if (!n)
+      return;
+    spans.reserve(n);
+    spans.push_back(std::make_pair(0, n - 1));
+    for (i = 0; i < n; i++) {
+      lo = spans[i].first;
+      hi = spans[i].second;
+      mid = lo + (hi - lo) / 2;
+      nodes_.emplace_back(items[mid].first, std::move(items[mid].second));
+      if (lo < mid) {
+        nodes_[i].left = (int32_t) spans.size();
+        spans.push_back(std::make_pair(lo, mid - 1));
+      }
+      if (mid < hi) {
+        nodes_[i].right = (int32_t) spans.size();
+        spans.push_back(std::make_pair(mid + 1, hi));
+      }
+    }
+    // Children are always stored after their parent: a reverse sweep computes max/min bottom-up
+    for (i = n - 1; i >= 0; i--) {
+      update(i);
+    }
+  }
+
+  /* The pool might be reallocated by the insertion: no reference to a node is kept across
+   * the recursive calls */
+  int32_t insert(int32_t pos, const range_type &r, Value &v)
+  {
+    int32_t child;
+
+    if (pos < 0) {
+      nodes_.emplace_back(r, std::move(v));
+      return (int32_t) nodes_.size() - 1;
+    }
+    if (before(r, nodes_[pos].range)) {
+      child = insert(nodes_[pos].left, r, v);
+      nodes_[pos].left = child;
+    } else if (before(nodes_[pos].range, r)) {
+      child = insert(nodes_[pos].right, r, v);
+      nodes_[pos].right = child;
+    } else {
+      nodes_[pos].value = std::move(v);
+      return pos;
+    }
+    return balance(pos);
+  }
+
+  int32_t unlink_min(int32_t pos, int32_t &min_node)
+  {
+    if (nodes_[pos].left < 0) {
+      min_node = pos;
+      return nodes_[pos].right;
+    }
+    nodes_[pos].left = unlink_min(nodes_[pos].left, min_node);
+    return balance(pos);
+  }
+
+  int32_t remove(int32_t pos, const range_type &r, int32_t &removed)
+  {
+    int32_t child, succ;
+
+    if (pos < 0)
+      return -1;
+    if (before(r, nodes_[pos].range)) {
+      nodes_[pos].left = remove(nodes_[pos].left, r, removed);
+    } else if (before(nodes_[pos].range, r)) {
+      nodes_[pos].right = remove(nodes_[pos].right, r, removed);
+    } else {
+      removed = pos;
+      if (nodes_[pos].left < 0)
+        return nodes_[pos].right;
+      if (nodes_[pos].right < 0)
+        return nodes_[pos].left;
+      // The in-order successor takes the place of the node: no value is moved
+      child = unlink_min(nodes_[pos].right, succ);
+      nodes_[succ].left = nodes_[pos].left;
+      nodes_[succ].right = child;
+      pos = succ;
+    }
+    return balance(pos);
+  }
+
+  /* The node at pos is not linked anymore: move the last node of the pool to its place */
+  void compact(int32_t pos)
+  {
+    int32_t last = (int32_t) nodes_.size() - 1, p;
+
+    if (pos != last) {
+      nodes_[pos] = std::move(nodes_[last]);
+      if (root_ == last) {
+        root_ = pos;
+      } else {
+        for (p = root_; p >= 0; p = before(nodes_[pos].range, nodes_[p].range) ? nodes_[p].left : nodes_[p].right) {
+          if (nodes_[p].left == last) {
+            nodes_[p].left = pos;
+            break;
+          }
+          if (nodes_[p].right == last) {
+            nodes_[p].right = pos;
+            break;
+          }
+        }
+      }
+    }
+    nodes_.pop_back();
+  }
+
+  /* Visit every range that overlaps [a, b] in pre-order. Returns true if the visitor asked to stop. */
+  template <typename Visitor>
+  bool overlap(int32_t pos, const Key &a, const Key &b, Visitor &visitor, size_t &ncoincidences) const
+  {
+    if (pos < 0)
+      return false;
+
+    const node &n = nodes_[pos];
+    if (less(n.max, a) || less(b, n.min))
+      return false;
+    if (!less(b, n.range.inf) && !less(n.range.sup, a)) {
+      ncoincidences++;
+      if (visitor(n.range, n.value))
+        return true;
+    }
+    if (overlap(n.left, a, b, visitor, ncoincidences))
+      return true;
+    // Every range of the right subtree starts after the root's interval
+    if (less(b, n.range.inf))
+      return false;
+    return overlap(n.right, a, b, visitor, ncoincidences);
+  }
+
+  std::vector<node> nodes_;
+  int32_t root_;
+  Compare cmp_;
+};
+
+} // namespace interval_trees
+
+#endif /* INTERVAL_TREE_HPP */
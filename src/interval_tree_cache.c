@@ -0,0 +1,105 @@
+/**
+ * @file interval_tree_cache.c
+ * Set-associative cache of the results of interval_tree_query.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdlib.h>
+
+#include "interval_tree_private.h"
+#include "interval_tree_cache.h"
+
+struct _cache_entry_t {
+  interval_key_t key;
+  void *v;
+  uint64_t generation;    /**< Of the tree when the entry was filled plus one (0 if empty) */
+};
+
+struct _interval_tree_cache_t {
+  interval_tree_t *tree;
+  struct _cache_entry_t *entries;
+  uint64_t mask;          /**< Number of sets minus one */
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/* Fibonacci hashing: consecutive keys and aligned prefixes are spread over all the sets */
+static inline uint64_t __set(interval_tree_cache_t* me, interval_key_t k)
+{
+  uint64_t h = (uint64_t) k;
+
+#ifdef INTERVAL_TREE_KEY128
+  h ^= (uint64_t) (k >> 64);
+#endif
+  return ((h * 0x9E3779B97F4A7C15ULL) >> 32) & me->mask;
+}
+
+interval_tree_cache_t* interval_tree_cache_new(interval_tree_t* tree, int entries)
+{
+  interval_tree_cache_t* me;
+  uint64_t sets;
+
+  for (sets = 1; sets * INTERVAL_TREE_CACHE_WAYS < (uint64_t) entries; sets *= 2);
+  me = calloc(1, sizeof(interval_tree_cache_t));
+  if (!me)
+    return NULL;
+  me->entries = calloc(sets * INTERVAL_TREE_CACHE_WAYS, sizeof(struct _cache_entry_t));
+  if (!me->entries) {
+    free(me);
+    return NULL;
+  }
+  me->tree = tree;
+  me->mask = sets - 1;
+  return me;
+}
+
+void interval_tree_cache_free(interval_tree_cache_t* me)
+{
+  if (me) {
+    free(me->entries);
+    free(me);
+  }
+}
+
+void *interval_tree_cache_query(interval_tree_cache_t* me, interval_key_t k)
+{
+  struct _cache_entry_t *set = &me->entries[__set(me, k) * INTERVAL_TREE_CACHE_WAYS];
+  uint64_t generation = me->tree->generation + 1;
+  int i, victim = INTERVAL_TREE_CACHE_WAYS - 1;
+  void *v;
+
+  for (i = 0; i < INTERVAL_TREE_CACHE_WAYS; i++) {
+    if (set[i].key == k && set[i].generation) {
+      if (set[i].generation == generation) {
+        me->hits++;
+        return set[i].v;
+      }
+      victim = i; // Invalidated by a modification of the tree: refill it in place
+      break;
+    }
+  }
+
+  me->misses++;
+  v = interval_tree_query(me->tree, k);
+  // The new key enters the set as the most recent one and the oldest one leaves it (FIFO)
+  for (i = victim; i > 0; i--)
+    set[i] = set[i - 1];
+  set[0].key = k;
+  set[0].v = v;
+  set[0].generation = generation;
+  return v;
+}
+
+void interval_tree_cache_stats(interval_tree_cache_t* me, interval_tree_cache_stats_t *stats)
+{
+  stats->hits = me->hits;
+  stats->misses = me->misses;
+  stats->entries = (int) ((me->mask + 1) * INTERVAL_TREE_CACHE_WAYS);
+}
+
+void interval_tree_cache_stats_reset(interval_tree_cache_t* me)
+{
+  me->hits = 0;
+  me->misses = 0;
+}
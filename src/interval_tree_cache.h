@@ -0,0 +1,80 @@
+/**
+ * @file interval_tree_cache.h
+ * Optional cache of the results of interval_tree_query for skewed traffic, where a few keys
+ * are looked up most of the time.
+ *
+ * The cache is set-associative, with a fixed number of entries that store a key and the value
+ * that interval_tree_query returned for it (NULL included). Every entry is tagged with the
+ * generation of the tree, which interval_tree_insert and interval_tree_remove increment, so a
+ * modification of the tree invalidates all the entries in O(1).
+ *
+ * A cache belongs to a single thread: it is not protected by any lock, and every thread that
+ * looks up the same tree creates its own one, so the hot keys do not introduce a shared
+ * point of contention. The usual rules of interval_tree_query apply: the tree must not be
+ * modified while it is being searched.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifndef INTERVAL_TREE_CACHE_H
+#define INTERVAL_TREE_CACHE_H
+
+#include "interval_tree.h"
+
+#define INTERVAL_TREE_CACHE_WAYS 4 /**< Entries per set */
+
+typedef struct _interval_tree_cache_t interval_tree_cache_t; /**< Opaque structure of the cache */
+
+/**
+ * @brief Hits and misses of a cache since its creation or the last interval_tree_cache_stats_reset.
+ */
+struct _interval_tree_cache_stats_t {
+  uint64_t hits;
+  uint64_t misses;        /**< Lookups that searched the tree (invalidated entries included) */
+  int entries;            /**< Capacity of the cache */
+};
+typedef struct _interval_tree_cache_stats_t interval_tree_cache_stats_t;
+
+/**
+ * @brief Create a cache in front of a tree.
+ *
+ * @param tree A interval tree that has been previously allocated by a call to interval_tree_new.
+ * It must not be freed before the cache.
+ * @param entries Number of keys that the cache can hold. It is rounded up to a power of two
+ * (at least INTERVAL_TREE_CACHE_WAYS).
+ * @return NULL if the cache could not be allocated.
+ */
+interval_tree_cache_t* interval_tree_cache_new(interval_tree_t* tree, int entries);
+
+/**
+ * @brief Free a previous allocated cache. The tree is not freed.
+ *
+ * @param me The returned value by the interval_tree_cache_new function.
+ */
+void interval_tree_cache_free(interval_tree_cache_t* me);
+
+/**
+ * @brief interval_tree_query through the cache: the same value is returned.
+ *
+ * @param me A cache that has been previously allocated by a call to interval_tree_cache_new.
+ * @param k The integer to search.
+ * @return The value associated to the matched range, NULL if no occurence has appeared.
+ */
+void *interval_tree_cache_query(interval_tree_cache_t* me, interval_key_t k);
+
+/**
+ * @brief Collect the hits and misses of a cache.
+ *
+ * @param me A cache that has been previously allocated by a call to interval_tree_cache_new.
+ * @param stats The structure that receives the statistics.
+ */
+void interval_tree_cache_stats(interval_tree_cache_t* me, interval_tree_cache_stats_t *stats);
+
+/**
+ * @brief Set the hits and misses of a cache to 0.
+ *
+ * @param me A cache that has been previously allocated by a call to interval_tree_cache_new.
+ */
+void interval_tree_cache_stats_reset(interval_tree_cache_t* me);
+
+#endif /* INTERVAL_TREE_CACHE_H */
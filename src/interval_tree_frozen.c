@@ -0,0 +1,243 @@
+/**
+ * @file interval_tree_frozen.c
+ * Read-only "compiled" form of an interval tree.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__) && !defined(INTERVAL_TREE_KEY128)
+#include <immintrin.h>
+#endif
+
+#include "interval_tree_private.h"
+#include "interval_tree_frozen.h"
+
+#define CACHE_LINE 64
+#define B ((int) (CACHE_LINE / sizeof(interval_key_t))) /* Keys per node of the static B-tree */
+
+struct _interval_tree_frozen_t {
+  int nsegments;
+  interval_key_t *bounds;  /**< First key of every segment, sorted */
+  void **first;            /**< Value returned by interval_tree_query for each segment */
+  int *list;               /**< Offset in values of the matches of each segment */
+  int *nvalues;            /**< Number of matches of each segment */
+  void **values;           /**< NULL terminated lists of matches */
+
+  /* Static B-tree over bounds: node k holds B keys and its children are k * (B + 1) + i + 1 */
+  int nblocks;
+  interval_key_t *btree;
+  int *btree_idx;          /**< Position in bounds of each key of the B-tree */
+};
+
+static int __go(int k, int i)
+{
+  return k * (B + 1) + i + 1;
+}
+
+static int cmp_key(const void *e1, const void *e2)
+{
+  interval_key_t a = *(const interval_key_t *)e1, b = *(const interval_key_t *)e2;
+
+  return a < b ? -1 : a > b;
+}
+
+/* In-order traversal of the B-tree filling it with the sorted bounds */
+static void __build_btree(interval_tree_frozen_t* f, int k, int *t)
+{
+  int i;
+
+  if (k >= f->nblocks)
+    return;
+
+  for (i = 0; i < B; i++) {
+    __build_btree(f, __go(k, i), t);
+    if (*t < f->nsegments) {
+      f->btree[k * B + i] = f->bounds[*t];
+      f->btree_idx[k * B + i] = (*t)++;
+    } else {
+      f->btree[k * B + i] = INTERVAL_KEY_MAX;
+      f->btree_idx[k * B + i] = f->nsegments;
+    }
+  }
+  __build_btree(f, __go(k, B), t);
+}
+
+/* Number of keys of a node lower or equal than k (they are sorted) */
+static inline int __rank_in_node(const interval_key_t *node, interval_key_t k)
+{
+#if defined(__AVX2__) && !defined(INTERVAL_TREE_KEY128)
+  __m256i x = _mm256_set1_epi64x(k);
+  __m256i gt_a = _mm256_cmpgt_epi64(_mm256_load_si256((const __m256i *) node), x);
+  __m256i gt_b = _mm256_cmpgt_epi64(_mm256_load_si256((const __m256i *) (node + 4)), x);
+  int mask = _mm256_movemask_pd(_mm256_castsi256_pd(gt_a)) |
+             (_mm256_movemask_pd(_mm256_castsi256_pd(gt_b)) << 4);
+
+  return __builtin_ctz(mask | (1 << B));
+#else
+  int i, r = 0;
+
+  for (i = 0; i < B; i++)
+    r += node[i] <= k;
+  return r;
+#endif
+}
+
+/* Index of the segment that contains k, -1 if k is lower than every bound */
+static int __segment(interval_tree_frozen_t* f, interval_key_t k)
+{
+  int node = 0, i, upper = f->nsegments;
+
+  while (node < f->nblocks) {
+    i = __rank_in_node(&f->btree[node * B], k);
+    if (i < B)
+      upper = f->btree_idx[node * B + i];
+    node = __go(node, i);
+  }
+  return upper - 1;
+}
+
+void interval_tree_frozen_free(interval_tree_frozen_t* f)
+{
+  if (f) {
+    free(f->bounds);
+    free(f->first);
+    free(f->list);
+    free(f->nvalues);
+    free(f->values);
+    free(f->btree);
+    free(f->btree_idx);
+    free(f);
+  }
+}
+
+struct _bounds_t {
+  interval_key_t *bounds;
+  int *nb;
+};
+
+static int __bounds_visitor(const range_t *r, void *v __attribute__((unused)), void *user)
+{
+  struct _bounds_t *b = (struct _bounds_t *)user;
+
+  b->bounds[(*b->nb)++] = r->inf;
+  if (r->sup != INTERVAL_KEY_MAX)
+    b->bounds[(*b->nb)++] = r->sup + 1;
+  return 0;
+}
+
+interval_tree_frozen_t* interval_tree_freeze(interval_tree_t* me)
+{
+  interval_tree_frozen_t* f;
+  interval_key_t *bounds = NULL;
+  void **buf = NULL, *first;
+  range_t all = { INTERVAL_KEY_MIN, INTERVAL_KEY_MAX };
+  struct _bounds_t b;
+  int i, j, n, m, nb, capacity, nvalues, values_size;
+
+  f = calloc(1, sizeof(interval_tree_frozen_t));
+  if (!f) return NULL;
+
+  /* Every range starts a segment at its lower limit and ends it after its upper limit */
+  bounds = malloc((2 * me->count + 1) * sizeof(interval_key_t));
+  if (!bounds) goto error;
+  nb = 0;
+  b.bounds = bounds;
+  b.nb = &nb;
+  interval_tree_overlap_query_cb(me, &all, __bounds_visitor, &b);
+  qsort(bounds, nb, sizeof(interval_key_t), cmp_key);
+  for (i = 0, m = 0; i < nb; i++) {
+    if (!m || bounds[m - 1] != bounds[i])
+      bounds[m++] = bounds[i];
+  }
+
+  f->bounds  = malloc((m + 1) * sizeof(interval_key_t));
+  f->first   = malloc((m + 1) * sizeof(void *));
+  f->list    = malloc((m + 1) * sizeof(int));
+  f->nvalues = malloc((m + 1) * sizeof(int));
+  capacity = 16;
+  buf = malloc(capacity * sizeof(void *));
+  values_size = m + 1;
+  f->values = malloc(values_size * sizeof(void *));
+  if (!f->bounds || !f->first || !f->list || !f->nvalues || !buf || !f->values) goto error;
+
+  /* All the keys of a segment have the same answer: ask the tree for its first key and merge
+   * consecutive segments with the same answer */
+  for (i = 0, nvalues = 0; i < m; i++) {
+    while ((n = interval_tree_multiple_query_r(me, bounds[i], buf, capacity)) > capacity) {
+      void **array_buf;
+
+      array_buf = realloc(buf, n * sizeof(void *));
+      if (!array_buf) goto error;
+      buf = array_buf;
+      capacity = n;
+    }
+    first = interval_tree_query(me, bounds[i]);
+
+    j = f->nsegments - 1;
+    if (j >= 0 && f->first[j] == first && f->nvalues[j] == n &&
+        !memcmp(&f->values[f->list[j]], buf, n * sizeof(void *)))
+      continue;
+
+    if (nvalues + n + 1 > values_size) {
+      void **array_values;
+
+      while (nvalues + n + 1 > values_size)
+        values_size *= 2;
+      array_values = realloc(f->values, values_size * sizeof(void *));
+      if (!array_values) goto error;
+      f->values = array_values;
+    }
+    j = f->nsegments++;
+    f->bounds[j] = bounds[i];
+    f->first[j] = first;
+    f->list[j] = nvalues;
+    f->nvalues[j] = n;
+    memcpy(&f->values[nvalues], buf, n * sizeof(void *));
+    nvalues += n;
+    f->values[nvalues++] = NULL;
+  }
+
+  f->nblocks = (f->nsegments + B - 1) / B;
+  f->btree = aligned_alloc(CACHE_LINE, (f->nblocks ? f->nblocks : 1) * CACHE_LINE);
+  f->btree_idx = malloc((f->nblocks ? f->nblocks : 1) * B * sizeof(int));
+  if (!f->btree || !f->btree_idx) goto error;
+  i = 0;
+  __build_btree(f, 0, &i);
+
+  free(bounds);
+  free(buf);
+  return f;
+
+error:
+  free(bounds);
+  free(buf);
+  interval_tree_frozen_free(f);
+  return NULL;
+}
+
+void *interval_tree_frozen_query(interval_tree_frozen_t* f, interval_key_t k)
+{
+  int s = __segment(f, k);
+
+  return s < 0 ? NULL : f->first[s];
+}
+
+void * const *interval_tree_frozen_multiple_query(interval_tree_frozen_t* f, interval_key_t k, int *n)
+{
+  static void * const empty[1] = { NULL };
+  int s = __segment(f, k);
+
+  if (s < 0) {
+    if (n) *n = 0;
+    return empty;
+  }
+  if (n) *n = f->nvalues[s];
+  return &f->values[f->list[s]];
+}
+
+int interval_tree_frozen_segments(interval_tree_frozen_t* f)
+{
+  return f->nsegments;
+}
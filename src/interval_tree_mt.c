@@ -0,0 +1,396 @@
+/**
+ * @file interval_tree_mt.c
+ * Interval tree that can be queried by any number of threads while a writer modifies it.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "epoch.h"
+#include "interval_tree_private.h"
+#include "interval_tree_mt.h"
+
+enum {
+  MT_OP_INSERT,
+  MT_OP_REMOVE
+};
+
+struct _mt_op_t {
+  int type;
+  range_t range;
+  void *v;
+};
+
+struct _interval_tree_mt_t {
+  interval_tree_t *replicas[2];
+  _Atomic(interval_tree_t *) active; /**< The replica that readers see */
+  epoch_domain_t *epoch;
+  pthread_mutex_t writer;
+  struct _mt_op_t *pending;          /**< Operations published but not applied to the other replica */
+  int npending;
+  int pending_size;
+  int standby_busy;                  /**< Readers might still be inside the other replica */
+  int retired;                       /**< Replaced replicas that have not been released yet */
+};
+
+struct _interval_tree_mt_reader_t {
+  interval_tree_mt_t *tree;
+  epoch_reader_t *r;
+};
+
+static interval_tree_mt_t* __mt_new(interval_tree_t *a, interval_tree_t *b)
+{
+  interval_tree_mt_t* me;
+
+  me = calloc(1, sizeof(interval_tree_mt_t));
+  if (!me || !a || !b || !(me->epoch = epoch_domain_new())) {
+    interval_tree_free(a);
+    interval_tree_free(b);
+    free(me);
+    return NULL;
+  }
+  me->replicas[0] = a;
+  me->replicas[1] = b;
+  atomic_init(&me->active, a);
+  pthread_mutex_init(&me->writer, NULL);
+  return me;
+}
+
+interval_tree_mt_t* interval_tree_mt_new(int initial_size)
+{
+  return __mt_new(interval_tree_new(initial_size), interval_tree_new(initial_size));
+}
+
+interval_tree_mt_t* interval_tree_mt_build(range_t *ranges, void **values, int n)
+{
+  return __mt_new(interval_tree_build(ranges, values, n), interval_tree_build(ranges, values, n));
+}
+
+void interval_tree_mt_free(interval_tree_mt_t* me)
+{
+  if (me) {
+    interval_tree_free(me->replicas[0]);
+    interval_tree_free(me->replicas[1]);
+    epoch_domain_free(me->epoch);
+    pthread_mutex_destroy(&me->writer);
+    free(me->pending);
+    free(me);
+  }
+}
+
+static void __release_tree(void *p)
+{
+  interval_tree_free(p);
+}
+
+/* Apply an operation to a replica. A range that is not in the tree is not in the other
+ * replica either, so only the memory that could not be allocated is an error */
+static int __apply(interval_tree_t *t, struct _mt_op_t *op)
+{
+  switch (op->type) {
+  case MT_OP_INSERT:
+    return interval_tree_insert(t, &op->range, op->v);
+  case MT_OP_REMOVE:
+    // The replicas never coalesce: with the entry of the node reserved, it cannot fail
+    if (__interval_tree_free_reserve(t, 1))
+      return -1;
+    interval_tree_remove(t, &op->range);
+    break;
+  }
+  return 0;
+}
+
+/* Apply a batch of operations to the hidden replica and publish it. The writer lock must be held.
+ * It stops at the first operation that fails: the ones before it are published and -1 is
+ * returned. If the replay of the pending operations fails, nothing is published. */
+static int __write_locked(interval_tree_mt_t* me, struct _mt_op_t *ops, int nops)
+{
+  interval_tree_t *standby;
+  int i, ret = 0;
+
+  if (nops > me->pending_size) {
+    struct _mt_op_t *array_ops;
+    int size = me->pending_size ? me->pending_size : 16;
+
+    while (size < nops)
+      size *= 2;
+    array_ops = realloc(me->pending, size * sizeof(struct _mt_op_t));
+    if (!array_ops)
+      return -1;
+    me->pending = array_ops;
+    me->pending_size = size;
+  }
+
+  /* Release the replicas replaced by a builder that nobody reads any more */
+  if (me->retired)
+    me->retired = epoch_reclaim(me->epoch);
+
+  standby = me->replicas[atomic_load(&me->active) == me->replicas[0]];
+
+  /* Readers that loaded the standby replica before the last publication must leave it */
+  if (me->standby_busy) {
+    epoch_synchronize(me->epoch);
+    me->standby_busy = 0;
+  }
+
+  /* Bring it up to date. The operations that it still misses are kept for the next write */
+  for (i = 0; i < me->npending; i++) {
+    if (__apply(standby, &me->pending[i])) {
+      memmove(me->pending, me->pending + i, (me->npending - i) * sizeof(struct _mt_op_t));
+      me->npending -= i;
+      return -1;
+    }
+  }
+  me->npending = 0;
+
+  /* Apply the new operations until one fails */
+  for (i = 0; i < nops; i++) {
+    if (__apply(standby, &ops[i])) {
+      ret = -1;
+      break;
+    }
+  }
+  nops = i;
+  if (!nops)
+    return ret;
+
+  atomic_store(&me->active, standby);
+  me->standby_busy = 1;
+
+  /* The replica that has just been hidden only misses the operations applied to the other one */
+  memcpy(me->pending, ops, nops * sizeof(struct _mt_op_t));
+  me->npending = nops;
+  return ret;
+}
+
+static int __write(interval_tree_mt_t* me, struct _mt_op_t *op)
+{
+  int ret;
+
+  pthread_mutex_lock(&me->writer);
+  ret = __write_locked(me, op, 1);
+  pthread_mutex_unlock(&me->writer);
+  return ret;
+}
+
+int interval_tree_mt_insert(interval_tree_mt_t* me, range_t *r, void *v)
+{
+  struct _mt_op_t op;
+
+  op.type = MT_OP_INSERT;
+  op.range = *r;
+  op.v = v;
+  return __write(me, &op);
+}
+
+int interval_tree_mt_remove(interval_tree_mt_t* me, range_t *r)
+{
+  struct _mt_op_t op;
+
+  op.type = MT_OP_REMOVE;
+  op.range = *r;
+  op.v = NULL;
+  return __write(me, &op);
+}
+
+interval_tree_mt_reader_t* interval_tree_mt_reader_new(interval_tree_mt_t* me)
+{
+  interval_tree_mt_reader_t* reader;
+
+  reader = calloc(1, sizeof(interval_tree_mt_reader_t));
+  if (!reader) return NULL;
+  reader->tree = me;
+  reader->r = epoch_register(me->epoch);
+  if (!reader->r) {
+    free(reader);
+    return NULL;
+  }
+  return reader;
+}
+
+void interval_tree_mt_reader_free(interval_tree_mt_reader_t* reader)
+{
+  if (reader) {
+    epoch_unregister(reader->tree->epoch, reader->r);
+    free(reader);
+  }
+}
+
+interval_tree_t* interval_tree_mt_read_begin(interval_tree_mt_reader_t* reader)
+{
+  epoch_enter(reader->tree->epoch, reader->r);
+  return atomic_load(&reader->tree->active);
+}
+
+void interval_tree_mt_read_end(interval_tree_mt_reader_t* reader)
+{
+  epoch_exit(reader->r);
+}
+
+void *interval_tree_mt_query(interval_tree_mt_reader_t* reader, interval_key_t k)
+{
+  void *v;
+
+  v = interval_tree_query(interval_tree_mt_read_begin(reader), k);
+  interval_tree_mt_read_end(reader);
+  return v;
+}
+
+struct _interval_tree_mt_builder_t {
+  interval_tree_mt_t *tree;
+  int nthreads;
+  range_t *ranges;        /**< Staged rule set */
+  void **values;
+  int n;
+  int size;
+};
+
+interval_tree_mt_builder_t* interval_tree_mt_builder_new(interval_tree_mt_t* me, int nthreads)
+{
+  interval_tree_mt_builder_t* b;
+
+  b = calloc(1, sizeof(interval_tree_mt_builder_t));
+  if (!b)
+    return NULL;
+  b->tree = me;
+  b->nthreads = nthreads;
+  return b;
+}
+
+void interval_tree_mt_builder_free(interval_tree_mt_builder_t* b)
+{
+  if (b) {
+    free(b->ranges);
+    free(b->values);
+    free(b);
+  }
+}
+
+int interval_tree_mt_builder_add(interval_tree_mt_builder_t* b, range_t *r, void *v)
+{
+  if (b->n == b->size) {
+    range_t *array_ranges;
+    void **array_values;
+    int size = b->size ? b->size * 2 : 1024;
+
+    array_ranges = realloc(b->ranges, size * sizeof(range_t));
+    if (!array_ranges)
+      return -1;
+    b->ranges = array_ranges;
+    array_values = realloc(b->values, size * sizeof(void *));
+    if (!array_values)
+      return -1;
+    b->values = array_values;
+    b->size = size;
+  }
+  b->ranges[b->n] = *r;
+  b->values[b->n] = v;
+  b->n++;
+  return 0;
+}
+
+/* Replace both replicas by trees built from the staged set */
+static int __publish_full(interval_tree_mt_builder_t* b)
+{
+  interval_tree_mt_t *me = b->tree;
+  interval_tree_t *old[2], *fresh[2];
+
+  /* Built off to the side: neither readers nor writers wait for it */
+  fresh[0] = interval_tree_build_parallel(b->ranges, b->values, b->n, b->nthreads);
+  fresh[1] = interval_tree_build_parallel(b->ranges, b->values, b->n, b->nthreads);
+  if (!fresh[0] || !fresh[1]) {
+    interval_tree_free(fresh[0]);
+    interval_tree_free(fresh[1]);
+    return -1;
+  }
+
+  pthread_mutex_lock(&me->writer);
+  old[0] = me->replicas[0];
+  old[1] = me->replicas[1];
+  me->replicas[0] = fresh[0];
+  me->replicas[1] = fresh[1];
+  atomic_store(&me->active, fresh[0]);
+  me->npending = 0;
+  me->standby_busy = 0;
+
+  /* Readers keep using the old version until they finish: it is released by a later write
+   * or publication, without waiting for them */
+  epoch_retire(me->epoch, old[0], __release_tree);
+  epoch_retire(me->epoch, old[1], __release_tree);
+  me->retired = epoch_reclaim(me->epoch);
+  pthread_mutex_unlock(&me->writer);
+  return 0;
+}
+
+/* Apply the differences between the staged set and the published tree as a single batch */
+static int __publish_diff(interval_tree_mt_builder_t* b)
+{
+  interval_tree_mt_t *me = b->tree;
+  interval_tree_iterator_t it_new, it_cur;
+  interval_tree_t *staged;
+  struct _mt_op_t *ops = NULL, *array_ops;
+  int nops = 0, size = 0, has_new, has_cur, ret = -1;
+  long c;
+  range_t r_new, r_cur;
+  void *v_new, *v_cur;
+
+  /* Sorted and without duplicates, as the published tree is */
+  staged = interval_tree_build_parallel(b->ranges, b->values, b->n, b->nthreads);
+  if (!staged)
+    return -1;
+
+  pthread_mutex_lock(&me->writer);
+  /* The published replica is only modified by writers, which are excluded */
+  interval_tree_iterator_init(staged, &it_new);
+  interval_tree_iterator_init(atomic_load(&me->active), &it_cur);
+  has_new = interval_tree_iterator_next(&it_new, &r_new, &v_new);
+  has_cur = interval_tree_iterator_next(&it_cur, &r_cur, &v_cur);
+  while (has_new || has_cur) {
+    if (nops == size) {
+      size = size ? size * 2 : 16;
+      array_ops = realloc(ops, size * sizeof(struct _mt_op_t));
+      if (!array_ops)
+        goto out;
+      ops = array_ops;
+    }
+    c = !has_cur ? 1 : !has_new ? -1 : cmp_range(&r_new, &r_cur);
+    if (c < 0) {
+      ops[nops].type = MT_OP_REMOVE;
+      ops[nops].range = r_cur;
+      ops[nops].v = NULL;
+      nops++;
+      has_cur = interval_tree_iterator_next(&it_cur, &r_cur, &v_cur);
+      continue;
+    }
+    if (c > 0 || v_new != v_cur) {
+      ops[nops].type = MT_OP_INSERT;
+      ops[nops].range = r_new;
+      ops[nops].v = v_new;
+      nops++;
+    }
+    has_new = interval_tree_iterator_next(&it_new, &r_new, &v_new);
+    if (!c)
+      has_cur = interval_tree_iterator_next(&it_cur, &r_cur, &v_cur);
+  }
+  ret = nops ? __write_locked(me, ops, nops) : 0;
+
+out:
+  pthread_mutex_unlock(&me->writer);
+  interval_tree_free(staged);
+  free(ops);
+  return ret;
+}
+
+int interval_tree_mt_builder_publish(interval_tree_mt_builder_t* b, int diff)
+{
+  int ret;
+
+  ret = diff ? __publish_diff(b) : __publish_full(b);
+  if (!ret)
+    b->n = 0;
+  return ret;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file interval_tree_mt.h
+ * Interval tree that can be queried by any number of threads while a writer modifies it.
+ *
+ * Readers never take a lock: they announce an epoch, read the published tree and leave.
+ * The structure keeps two replicas of the tree. Writers (serialized by a mutex) modify the
+ * replica that readers do not see and publish it with an atomic store; the operation is
+ * replayed in the other replica on the next write, once every reader has left it (an epoch
+ * grace period). Therefore arrays reallocated by an insertion are only freed when no reader
+ * can reference them, at the cost of twice the memory.
+ *
+ * A whole new rule set can be loaded with a builder (interval_tree_mt_builder_new): the ranges
+ * are staged, the trees are built off to the side and published with a single atomic store,
+ * while readers finish their lookups in the previous version.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifndef INTERVAL_TREE_MT_H
+#define INTERVAL_TREE_MT_H
+
+#include "interval_tree.h"
+
+typedef struct _interval_tree_mt_t interval_tree_mt_t; /**< Opaque structure of the tree */
+typedef struct _interval_tree_mt_reader_t interval_tree_mt_reader_t; /**< Opaque per-thread reader */
+typedef struct _interval_tree_mt_builder_t interval_tree_mt_builder_t; /**< Opaque builder of rule sets */
+
+/**
+ * @brief Initializes an empty concurrent interval tree. See interval_tree_new.
+ *
+ * @param initial_size Initial array size.
+ * @return NULL if the tree could not be generated.
+ */
+interval_tree_mt_t* interval_tree_mt_new(int initial_size);
+
+/**
+ * @brief Initializes a concurrent interval tree from an array of ranges. See interval_tree_build.
+ *
+ * @return NULL if the tree could not be generated.
+ */
+interval_tree_mt_t* interval_tree_mt_build(range_t *ranges, void **values, int n);
+
+/**
+ * @brief Free a previous allocated structure. Every reader must have been released.
+ *
+ * @param me The returned value by the interval_tree_mt_new function.
+ */
+void interval_tree_mt_free(interval_tree_mt_t* me);
+
+/**
+ * @brief Insert a range in the tree. See interval_tree_insert. Concurrent readers are not blocked,
+ * they see the new range as soon as the function returns.
+ *
+ * @return 0 on success, -1 if the memory could not be allocated (the tree is not modified).
+ */
+int interval_tree_mt_insert(interval_tree_mt_t* me, range_t *r, void *v);
+
+/**
+ * @brief Remove a range from the tree. See interval_tree_remove. Concurrent readers are not blocked.
+ *
+ * @return 0 on success (also if the range was not in the tree), -1 if the memory could not be
+ * allocated (the tree is not modified).
+ */
+int interval_tree_mt_remove(interval_tree_mt_t* me, range_t *r);
+
+/**
+ * @brief Register the calling thread as a reader.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_mt_new.
+ * @return The reader that the thread must use for its queries, NULL if it could not be allocated.
+ */
+interval_tree_mt_reader_t* interval_tree_mt_reader_new(interval_tree_mt_t* me);
+
+/**
+ * @brief Unregister a reader. It must not be inside a read section.
+ *
+ * @param reader The returned value by interval_tree_mt_reader_new.
+ */
+void interval_tree_mt_reader_free(interval_tree_mt_reader_t* reader);
+
+/**
+ * @brief Start a read section. The returned tree can be used with every reentrant query function
+ * (interval_tree_query, interval_tree_query_batch, interval_tree_multiple_query_r,
+ * interval_tree_multiple_query_cb...) until interval_tree_mt_read_end. It must never be modified.
+ * Sections should be short: writers wait for them.
+ *
+ * @param reader The reader of the calling thread.
+ * @return The current version of the tree.
+ */
+interval_tree_t* interval_tree_mt_read_begin(interval_tree_mt_reader_t* reader);
+
+/**
+ * @brief Finish a read section started by interval_tree_mt_read_begin.
+ *
+ * @param reader The reader of the calling thread.
+ */
+void interval_tree_mt_read_end(interval_tree_mt_reader_t* reader);
+
+/**
+ * @brief Equivalent to interval_tree_query inside a read section.
+ *
+ * @param reader The reader of the calling thread.
+ * @param k The integer to search.
+ * @return The value associated to the matched range, NULL if no occurence has appeared.
+ */
+void *interval_tree_mt_query(interval_tree_mt_reader_t* reader, interval_key_t k);
+
+/**
+ * @brief Create a builder that replaces the content of a tree by a new rule set.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_mt_new.
+ * @param nthreads Threads used to build the new trees (see interval_tree_build_parallel).
+ * @return NULL if the builder could not be allocated.
+ */
+interval_tree_mt_builder_t* interval_tree_mt_builder_new(interval_tree_mt_t* me, int nthreads);
+
+/**
+ * @brief Free a builder. The ranges staged but not published are discarded.
+ *
+ * @param b The returned value by interval_tree_mt_builder_new.
+ */
+void interval_tree_mt_builder_free(interval_tree_mt_builder_t* b);
+
+/**
+ * @brief Stage a range of the new rule set. The tree is not modified until
+ * interval_tree_mt_builder_publish. If the same range is staged several times, the last
+ * value is kept.
+ *
+ * @param b The returned value by interval_tree_mt_builder_new.
+ * @param r The interval of the range.
+ * @param v Its value.
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+int interval_tree_mt_builder_add(interval_tree_mt_builder_t* b, range_t *r, void *v);
+
+/**
+ * @brief Make the staged rule set the content of the tree, and empty the builder so it can
+ * stage the next one. Lookups are never blocked: readers that are inside a read section keep
+ * using the previous version.
+ *
+ * With diff = 0, two new trees are built from the staged ranges without holding any lock, both
+ * replicas are replaced with an atomic store and the old ones are retired: the first write or
+ * publication after every reader has left them frees them, so the call does not wait for the
+ * readers. Insertions and removals performed since the builder started staging are lost.
+ * With diff != 0, only the ranges that were added or removed, or whose value changed, are
+ * applied to the current tree as a single batch (one publication), which is cheaper when
+ * the new rule set is similar to the current one and keeps the memory of the replicas.
+ *
+ * @param b The returned value by interval_tree_mt_builder_new.
+ * @param diff Apply the differences instead of replacing the trees.
+ * @return 0 on success, -1 if the memory could not be allocated. With diff = 0 the tree is not
+ * modified. With diff != 0 the differences applied before the failure stay published and the
+ * builder keeps the staged ranges: publishing again applies the rest.
+ */
+int interval_tree_mt_builder_publish(interval_tree_mt_builder_t* b, int diff);
+
+#endif /* INTERVAL_TREE_MT_H */
@@ -0,0 +1,347 @@
+/**
+ * @file interval_tree_pool.c
+ * Index-linked backend of the interval tree (make BACKEND=pool).
+ *
+ * The ranges are stored in a dense pool of nodes (the nodes array) that are linked with
+ * 32 bit indexes instead of occupying the positions of an implicit heap. A rotation only
+ * rewires three indexes, whereas the implicit heap has to move whole subtrees, and the
+ * memory is proportional to the number of ranges instead of to 2^height. The entries
+ * released by interval_tree_remove are reused through the same free list.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifdef INTERVAL_TREE_POOL
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "interval_tree_private.h"
+
+#define max(x,y) ((x) < (y) ? (y) : (x))
+
+static int __height(interval_tree_t* me, int pos)
+{
+  return pos < 0 ? 0 : me->nodes[pos].height;
+}
+
+/* The children of pos changed: recompute its height and its augmented data */
+static void __update(interval_tree_t* me, int pos)
+{
+  interval_node_t *n = &me->nodes[pos];
+  int hl = __height(me, n->left), hr = __height(me, n->right);
+
+  n->height = 1 + max(hl, hr);
+  __node_reset(n);
+  if (n->left >= 0)
+    __node_merge(n, &me->nodes[n->left]);
+  if (n->right >= 0)
+    __node_merge(n, &me->nodes[n->right]);
+}
+
+/* The right child of pos becomes the root of the subtree, which is returned */
+static int __rotate_left(interval_tree_t* me, int pos)
+{
+  int r = me->nodes[pos].right;
+
+  STATS_ADD(me, rotations, 1);
+  me->nodes[pos].right = me->nodes[r].left;
+  me->nodes[r].left = pos;
+  __update(me, pos);
+  __update(me, r);
+  return r;
+}
+
+/* The left child of pos becomes the root of the subtree, which is returned */
+static int __rotate_right(interval_tree_t* me, int pos)
+{
+  int l = me->nodes[pos].left;
+
+  STATS_ADD(me, rotations, 1);
+  me->nodes[pos].left = me->nodes[l].right;
+  me->nodes[l].right = pos;
+  __update(me, pos);
+  __update(me, l);
+  return l;
+}
+
+/* Restore the AVL property of the subtree rooted at pos, whose children are balanced.
+ * Returns the new root of the subtree. */
+static int __balance(interval_tree_t* me, int pos)
+{
+  interval_node_t *n = &me->nodes[pos];
+  int bf = __height(me, n->left) - __height(me, n->right);
+
+  if (bf > 1) {
+    if (__height(me, me->nodes[n->left].left) < __height(me, me->nodes[n->left].right))
+      n->left = __rotate_left(me, n->left);
+    return __rotate_right(me, pos);
+  }
+  if (bf < -1) {
+    if (__height(me, me->nodes[n->right].right) < __height(me, me->nodes[n->right].left))
+      n->right = __rotate_right(me, n->right);
+    return __rotate_left(me, pos);
+  }
+  __update(me, pos);
+  return pos;
+}
+
+static int __grow(interval_tree_t* me, int size)
+{
+  interval_node_t *array_nodes;
+  void **array_return;
+
+  array_return = __interval_tree_alloc(&me->allocator, (size + 1) * sizeof(void *));
+  if (!array_return)
+    return -1;
+  array_nodes = __interval_tree_realloc(&me->allocator, me->nodes, me->size * sizeof(interval_node_t),
+                                        size * sizeof(interval_node_t));
+  if (!array_nodes) {
+    __interval_tree_release(&me->allocator, array_return, (size + 1) * sizeof(void *));
+    return -1;
+  }
+  me->nodes = array_nodes;
+
+  STATS_ADD(me, enlargements, 1);
+  STATS_ADD(me, bytes_copied, me->size * sizeof(interval_node_t));
+
+  __interval_tree_release(&me->allocator, me->multiple_query_return, (me->size + 1) * sizeof(void *));
+  me->size = size;
+  me->multiple_query_return = array_return;
+  return 0;
+}
+
+static int __enlarge(interval_tree_t* me)
+{
+  return __grow(me, me->size * 2);
+}
+
+interval_tree_t* interval_tree_new(int initial_size)
+{
+  return interval_tree_new_with_allocator(initial_size, NULL);
+}
+
+interval_tree_t* interval_tree_new_with_allocator(int initial_size, const interval_tree_allocator_t *allocator)
+{
+  interval_tree_t* me;
+
+  if (!allocator)
+    allocator = &__interval_tree_default_allocator;
+  if (initial_size < 1)
+    initial_size = 1;
+  me = __interval_tree_alloc(allocator, sizeof(interval_tree_t));
+  if (!me)
+    return NULL;
+  me->allocator = *allocator;
+  me->size = initial_size;
+  me->root = -1;
+  me->nodes = __interval_tree_alloc(allocator, initial_size * sizeof(interval_node_t));
+  me->multiple_query_return = __interval_tree_alloc(allocator, (initial_size + 1) * sizeof(void *));
+  if (!me->nodes || !me->multiple_query_return) {
+    interval_tree_free(me);
+    return NULL;
+  }
+  return me;
+}
+
+struct _build_args_t {
+  interval_tree_t* me;
+  range_t *ranges;
+  void **values;
+  int lo, hi;
+  int pos;      /**< Entry of the root of the subtree */
+  int threads;  /**< Available for the subtree */
+  int root;     /**< Returned: pos, or -1 if the subtree is empty */
+};
+
+/* Lay out the subtree in pre-order, so a depth-first search walks the pool forwards. The
+ * entries of every subtree are known in advance, so both children can be built by
+ * different threads. */
+static void *__build(void *p)
+{
+  struct _build_args_t *a = p, l, r;
+  interval_node_t *n;
+  int mid;
+
+  if (a->lo > a->hi) {
+    a->root = -1;
+    return NULL;
+  }
+  mid = a->lo + (a->hi - a->lo) / 2;
+  n = &a->me->nodes[a->pos];
+  n->range = a->ranges[mid];
+  n->v = a->values[mid];
+
+  l = r = *a;
+  l.hi = mid - 1;
+  l.pos = a->pos + 1;
+  r.lo = mid + 1;
+  r.pos = a->pos + 1 + (mid - a->lo);
+  if (a->threads <= 1 || a->hi - a->lo < PARALLEL_GRAIN) {
+    __build(&l);
+    __build(&r);
+  } else {
+    l.threads = a->threads / 2;
+    r.threads = a->threads - l.threads;
+    __interval_tree_fork(__build, &l, __build, &r);
+  }
+  n->left = l.root;
+  n->right = r.root;
+  __update(a->me, a->pos);
+  a->root = a->pos;
+  return NULL;
+}
+
+interval_tree_t* __interval_tree_build_sorted(range_t *ranges, void **values, int n, int nthreads,
+                                              const interval_tree_allocator_t *allocator)
+{
+  struct _build_args_t a = { NULL, ranges, values, 0, n - 1, 0, nthreads, -1 };
+
+  a.me = interval_tree_new_with_allocator(n, allocator);
+  if (!a.me)
+    return NULL;
+  __build(&a);
+  a.me->root = a.root;
+  a.me->count = n;
+  a.me->used = n;
+  return a.me;
+}
+
+/* Index of the node that the next insertion will use: a released one if there is any */
+static int __node_next(interval_tree_t* me)
+{
+  if (me->nfree)
+    return me->free_nodes[me->nfree - 1];
+  if (me->used >= me->size && __enlarge(me))
+    return -1;
+  return me->used;
+}
+
+/* Insert r in the subtree rooted at pos. node is the free entry that will hold it.
+ * Returns the new root of the subtree. */
+static int __insert(interval_tree_t* me, int pos, range_t *r, void *v, int node)
+{
+  long c;
+  int child;
+
+  if (pos < 0) {
+    me->nodes[node].range = *r;
+    me->nodes[node].v = v;
+    me->nodes[node].merged = 0;
+    me->nodes[node].left = -1;
+    me->nodes[node].right = -1;
+    __update(me, node);
+    if (me->nfree)
+      me->nfree--;
+    else
+      me->used++;
+    me->count++;
+    return node;
+  }
+
+  c = cmp_range(r, &me->nodes[pos].range);
+  if (c == 0) {
+    // Same range: just update the value of the node already stored
+    me->nodes[pos].v = v;
+    return pos;
+  }
+  if (c > 0) {
+    child = __insert(me, me->nodes[pos].left, r, v, node);
+    me->nodes[pos].left = child;
+  } else {
+    child = __insert(me, me->nodes[pos].right, r, v, node);
+    me->nodes[pos].right = child;
+  }
+  return __balance(me, pos);
+}
+
+int __interval_tree_add(interval_tree_t* me, range_t *r, void *v)
+{
+  int node;
+
+  node = __node_next(me);
+  if (node < 0)
+    return -1;
+  me->generation++;
+  me->root = __insert(me, me->root, r, v, node);
+  return 0;
+}
+
+/* Unlink the minimum of the subtree rooted at pos, which is returned in *node.
+ * Returns the new root of the subtree. */
+static int __unlink_min(interval_tree_t* me, int pos, int *node)
+{
+  int child;
+
+  if (me->nodes[pos].left < 0) {
+    *node = pos;
+    return me->nodes[pos].right;
+  }
+  child = __unlink_min(me, me->nodes[pos].left, node);
+  me->nodes[pos].left = child;
+  return __balance(me, pos);
+}
+
+/* Unlink r from the subtree rooted at pos, its entry is returned in *node.
+ * Returns the new root of the subtree. */
+static int __remove(interval_tree_t* me, int pos, range_t *r, int *node)
+{
+  long c;
+  int child, succ;
+
+  if (pos < 0)
+    return -1;
+
+  c = cmp_range(r, &me->nodes[pos].range);
+  if (c > 0) {
+    child = __remove(me, me->nodes[pos].left, r, node);
+    me->nodes[pos].left = child;
+  } else if (c < 0) {
+    child = __remove(me, me->nodes[pos].right, r, node);
+    me->nodes[pos].right = child;
+  } else {
+    *node = pos;
+    if (me->nodes[pos].left < 0)
+      return me->nodes[pos].right;
+    if (me->nodes[pos].right < 0)
+      return me->nodes[pos].left;
+    // The in-order successor takes the place of the node: no range is copied
+    child = __unlink_min(me, me->nodes[pos].right, &succ);
+    me->nodes[succ].left = me->nodes[pos].left;
+    me->nodes[succ].right = child;
+    pos = succ;
+  }
+  return __balance(me, pos);
+}
+
+int __interval_tree_delete(interval_tree_t* me, range_t *r)
+{
+  int node = -1;
+
+  if (__interval_tree_free_reserve(me, 1))
+    return -1;
+
+  me->root = __remove(me, me->root, r, &node);
+  if (node < 0)
+    return -1;
+
+  me->free_nodes[me->nfree++] = node;
+  me->count--;
+  me->generation++;
+  return 0;
+}
+
+void __interval_tree_swap(interval_tree_t* me, interval_tree_t* other)
+{
+  interval_tree_t tmp = *me;
+
+  *me = *other;
+  *other = tmp;
+}
+
+int __interval_tree_reserve_nodes(interval_tree_t* me, int n)
+{
+  return n > me->size ? __grow(me, n) : 0;
+}
+
+#endif /* INTERVAL_TREE_POOL */
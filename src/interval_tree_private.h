@@ -0,0 +1,263 @@
+/**
+ * @file interval_tree_private.h
+ * Internal layout of the interval tree, shared by the modules that extend it.
+ * It is not part of the public interface.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifndef INTERVAL_TREE_PRIVATE_H
+#define INTERVAL_TREE_PRIVATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "avl_tree.h"
+#include "interval_tree.h"
+
+/* Number of keys of a range minus one. Unsigned, so [INTERVAL_KEY_MIN, INTERVAL_KEY_MAX] fits */
+#ifdef INTERVAL_TREE_KEY128
+typedef unsigned __int128 interval_width_t;
+#else
+typedef uint64_t interval_width_t;
+#endif
+
+static inline interval_width_t __range_width(const range_t *r)
+{
+  return (interval_width_t) r->sup - (interval_width_t) r->inf;
+}
+
+struct _interval_node_t {
+  interval_key_t max;
+  interval_key_t min;
+  interval_width_t min_width; /**< Of the narrowest range of the subtree */
+  interval_key_t min_sup;     /**< Smallest upper limit of the subtree */
+  interval_key_t max_inf;     /**< Greatest lower limit of the subtree */
+  int32_t ranges;             /**< Stored in the subtree */
+  int32_t merged;             /**< It covers ranges kept in the absorbed tree (coalescing) */
+  range_t range;
+  void *v;
+#ifdef INTERVAL_TREE_POOL
+  int32_t left;    /**< Index in nodes of the children (-1 if there is none) */
+  int32_t right;
+  int32_t height;  /**< Of the subtree rooted at this node (1 for a leaf) */
+#endif
+};
+typedef struct _interval_node_t interval_node_t;
+
+#ifdef INTERVAL_TREE_STATS
+/* Updated with relaxed atomics: queries can run in several threads at the same time */
+struct _interval_tree_counters_t {
+  uint64_t queries;
+  uint64_t nodes_visited;
+  uint64_t rotations;     /* Of the pool backend, the AVL tree counts its own ones */
+  uint64_t shift_up;
+  uint64_t shift_down;
+  uint64_t enlargements;
+  uint64_t bytes_copied;
+};
+#define STATS_ADD(me, field, n) __atomic_fetch_add(&(me)->stats.field, (n), __ATOMIC_RELAXED)
+#else
+#define STATS_ADD(me, field, n) do {} while (0)
+#endif
+
+struct _interval_tree_t {
+  avltree_t *tree; /**< NULL if the tree is mapped from a snapshot */
+  interval_node_t *nodes;
+  void **multiple_query_return;
+  int *nodes_perm; /**< Position in the AVL array -> index in nodes (-1 if empty) */
+  int perm_size;
+  int size;
+  int count;       /**< Ranges stored in the tree */
+  int used;        /**< Entries of nodes that have ever been used */
+  int *free_nodes; /**< Stack of entries of nodes released by interval_tree_remove */
+  int nfree;
+  int free_size;
+#ifdef INTERVAL_TREE_POOL
+  int root;        /**< Index in nodes of the root (-1 if the tree is empty) */
+#endif
+  interval_tree_allocator_t allocator; /**< Of the arrays and of the structure */
+  uint64_t generation; /**< Incremented by every modification, see interval_tree_cache */
+  int coalesce;    /**< See interval_tree_set_coalescing */
+  interval_tree_t *absorbed; /**< Ranges covered by a merged one, stored to undo the merge (NULL if none) */
+  void *map;       /**< Snapshot mapped by interval_tree_open_mmap (nodes and nodes_perm point into it) */
+  size_t map_size;
+#ifdef INTERVAL_TREE_STATS
+  struct _interval_tree_counters_t stats;
+#endif
+};
+
+/*
+ * Navigation shared by both backends. The default one keeps the nodes in the implicit heap of
+ * the AVL tree, so a position is an index in its array. The pool (INTERVAL_TREE_POOL, make
+ * BACKEND=pool) links the entries of nodes with their indexes, so a position is an entry of
+ * nodes. Queries only rely on these functions, so they also work on trees mapped from a
+ * snapshot (without AVL tree).
+ */
+#ifdef INTERVAL_TREE_POOL
+static inline int __tree_root(const interval_tree_t* me)
+{
+  return me->root;
+}
+
+static inline int __tree_left(const interval_tree_t* me, int pos)
+{
+  return me->nodes[pos].left;
+}
+
+static inline int __tree_right(const interval_tree_t* me, int pos)
+{
+  return me->nodes[pos].right;
+}
+
+/* Node stored at pos, NULL if it is empty */
+static inline interval_node_t *__node_at(const interval_tree_t* me, int pos)
+{
+  return pos < 0 ? NULL : &me->nodes[pos];
+}
+#else
+static inline int __tree_root(const interval_tree_t* me __attribute__((unused)))
+{
+  return 0;
+}
+
+static inline int __tree_left(const interval_tree_t* me __attribute__((unused)), int pos)
+{
+  return pos * 2 + 1;
+}
+
+static inline int __tree_right(const interval_tree_t* me __attribute__((unused)), int pos)
+{
+  return pos * 2 + 2;
+}
+
+/* Node stored at position pos of the AVL array, NULL if it is empty */
+static inline interval_node_t *__node_at(const interval_tree_t* me, int pos)
+{
+  int n = pos < me->perm_size ? me->nodes_perm[pos] : -1;
+
+  return n < 0 ? NULL : &me->nodes[n];
+}
+#endif
+
+/* Order of the ranges: 1 if e1 goes before e2 (smaller lower limit, then smaller upper limit) */
+static inline long cmp_range(const void *e1, const void *e2)
+{
+  const range_t *a = e1, *b = e2;
+
+  if (a->inf < b->inf || (a->inf == b->inf && a->sup < b->sup)) { // e2>e1
+    return 1;
+  } else if (a->inf == b->inf && a->sup == b->sup) {
+    return 0;
+  } else { // e2<e1
+    return -1;
+  }
+}
+
+/* Augmented data of a node without children */
+static inline void __node_reset(interval_node_t *n)
+{
+  n->max = n->range.sup;
+  n->min = n->range.inf;
+  n->min_width = __range_width(&n->range);
+  n->min_sup = n->range.sup;
+  n->max_inf = n->range.inf;
+  n->ranges = 1;
+}
+
+/* Add the augmented data of a child to the one of its parent */
+static inline void __node_merge(interval_node_t *n, const interval_node_t *child)
+{
+  if (child->max > n->max) n->max = child->max;
+  if (child->min < n->min) n->min = child->min;
+  if (child->min_width < n->min_width) n->min_width = child->min_width;
+  if (child->min_sup < n->min_sup) n->min_sup = child->min_sup;
+  if (child->max_inf > n->max_inf) n->max_inf = child->max_inf;
+  n->ranges += child->ranges;
+}
+
+/**
+ * @brief Memory of a tree, taken from its allocator (see interval_tree_new_with_allocator).
+ * __interval_tree_alloc returns it filled with zeros, and __interval_tree_realloc keeps the
+ * old content (the new part is not initialized). Both return NULL on failure.
+ */
+extern const interval_tree_allocator_t __interval_tree_default_allocator;
+void *__interval_tree_alloc(const interval_tree_allocator_t *a, size_t size);
+void *__interval_tree_realloc(const interval_tree_allocator_t *a, void *ptr, size_t old_size, size_t size);
+void __interval_tree_release(const interval_tree_allocator_t *a, void *ptr, size_t size);
+
+/**
+ * @brief Create a tree with the given ranges, implemented by the backend.
+ *
+ * @param ranges Sorted by cmp_range and without duplicates.
+ * @param values values[i] belongs to ranges[i].
+ * @param n Number of elements in the arrays.
+ * @param nthreads Maximum number of threads that lay out the subtrees, including the caller.
+ * @param allocator Of the new tree, NULL for the default one.
+ * @return NULL if the tree could not be generated.
+ */
+interval_tree_t* __interval_tree_build_sorted(range_t *ranges, void **values, int n, int nthreads,
+                                              const interval_tree_allocator_t *allocator);
+
+#define PARALLEL_GRAIN 32768 /**< Elements below which a parallel build does not create threads */
+
+/**
+ * @brief Run a(pa) in a new thread while b(pb) runs in the caller, and wait for both.
+ * If the thread cannot be created, a(pa) also runs in the caller.
+ */
+void __interval_tree_fork(void *(*a)(void *), void *pa, void *(*b)(void *), void *pb);
+
+/**
+ * @brief Run fn(arg, lo, hi) over consecutive pieces [lo, hi) that cover [0, n), in up to
+ * nthreads threads.
+ */
+void __interval_tree_parallel_for(int nthreads, int n, void (*fn)(void *arg, int lo, int hi), void *arg);
+
+/**
+ * @brief Exchange the content of two trees, implemented by the backend.
+ */
+void __interval_tree_swap(interval_tree_t* me, interval_tree_t* other);
+
+/**
+ * @brief Insert a range without merging it, implemented by the backend. The merged field of a
+ * new node is 0, and it is kept if the range was already stored.
+ *
+ * @return 0 on success, -1 if the memory could not be allocated (the tree is not modified).
+ */
+int __interval_tree_add(interval_tree_t* me, range_t *r, void *v);
+
+/**
+ * @brief Remove a range without looking at the absorbed tree, implemented by the backend.
+ *
+ * @return 0 if the range was removed, -1 if it was not in the tree or the memory could not be
+ * allocated (it cannot happen after __interval_tree_free_reserve).
+ */
+int __interval_tree_delete(interval_tree_t* me, range_t *r);
+
+/**
+ * @brief Insert the range that covers r and the ranges with value v that overlap or abut it,
+ * and move those to the absorbed tree, so the lookups of the tree are the same as if r had
+ * been inserted. Used by interval_tree_insert in coalescing mode.
+ *
+ * @param me The tree.
+ * @param r The range that is being inserted.
+ * @param v Its value.
+ * @return 0 on success, -1 if the memory could not be allocated (the tree is not modified).
+ */
+int __interval_tree_coalesce(interval_tree_t* me, range_t *r, void *v);
+
+/**
+ * @brief Guarantee that n entries can be pushed to the stack of released nodes.
+ *
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+int __interval_tree_free_reserve(interval_tree_t* me, int n);
+
+/**
+ * @brief Grow the arrays that hold the nodes to n ranges, implemented by the backend.
+ *
+ * @return 0 on success, -1 if the memory could not be allocated.
+ */
+int __interval_tree_reserve_nodes(interval_tree_t* me, int n);
+
+#endif /* INTERVAL_TREE_PRIVATE_H */
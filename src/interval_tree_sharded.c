@@ -0,0 +1,211 @@
+/**
+ * @file interval_tree_sharded.c
+ * Interval tree split in shards by key space, each one protected by its own lock.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "interval_tree_private.h"
+#include "interval_tree_sharded.h"
+
+#define SHARD_ALIGN 64 /**< A shard per cache line: writers of different shards do not share lines */
+
+struct _shard_t {
+  pthread_rwlock_t lock;
+  interval_tree_t *tree;
+  int owned;              /**< Ranges whose lower limit belongs to this shard */
+} __attribute__((aligned(SHARD_ALIGN)));
+
+struct _interval_tree_sharded_t {
+  int nshards;
+  interval_key_t first;
+  interval_width_t width; /**< Keys of every shard (0 if there is only one shard) */
+  struct _shard_t *shards;
+};
+
+/* Shard of the key k. The keys out of [first, last] go to the shard of the nearest limit */
+static int __shard(interval_tree_sharded_t* me, interval_key_t k)
+{
+  interval_width_t s;
+
+  if (k <= me->first || !me->width)
+    return 0;
+  s = ((interval_width_t) k - (interval_width_t) me->first) / me->width;
+  return s >= (interval_width_t) me->nshards ? me->nshards - 1 : (int) s;
+}
+
+interval_tree_sharded_t* interval_tree_sharded_new(int nshards, interval_key_t first, interval_key_t last)
+{
+  interval_tree_sharded_t* me;
+  int i;
+
+  if (nshards < 1 || last < first)
+    return NULL;
+  me = calloc(1, sizeof(interval_tree_sharded_t));
+  if (!me)
+    return NULL;
+  if (posix_memalign((void **)&me->shards, SHARD_ALIGN, nshards * sizeof(struct _shard_t))) {
+    free(me);
+    return NULL;
+  }
+  me->nshards = nshards;
+  me->first = first;
+  // With a single shard the whole key space could overflow the width, but it is not needed
+  me->width = nshards > 1 ? ((interval_width_t) last - (interval_width_t) first) / nshards + 1 : 0;
+  for (i = 0; i < nshards; i++) {
+    pthread_rwlock_init(&me->shards[i].lock, NULL);
+    me->shards[i].tree = interval_tree_new(64);
+    me->shards[i].owned = 0;
+    if (!me->shards[i].tree) {
+      me->nshards = i + 1;
+      interval_tree_sharded_free(me);
+      return NULL;
+    }
+  }
+  return me;
+}
+
+void interval_tree_sharded_free(interval_tree_sharded_t* me)
+{
+  int i;
+
+  if (me) {
+    for (i = 0; i < me->nshards; i++) {
+      interval_tree_free(me->shards[i].tree);
+      pthread_rwlock_destroy(&me->shards[i].lock);
+    }
+    free(me->shards);
+    free(me);
+  }
+}
+
+/* Take the write locks of the shards [first, last]. Always in ascending order, so two writers
+ * cannot wait for each other, and a writer that crosses boundaries modifies all its shards
+ * before any other writer of them: every shard sees the writers in the same order. */
+static void __write_lock(interval_tree_sharded_t* me, int first, int last)
+{
+  int s;
+
+  for (s = first; s <= last; s++)
+    pthread_rwlock_wrlock(&me->shards[s].lock);
+}
+
+static void __write_unlock(interval_tree_sharded_t* me, int first, int last)
+{
+  int s;
+
+  for (s = first; s <= last; s++)
+    pthread_rwlock_unlock(&me->shards[s].lock);
+}
+
+int interval_tree_sharded_insert(interval_tree_sharded_t* me, range_t *r, void *v)
+{
+  int s, first = __shard(me, r->inf), last = __shard(me, r->sup);
+  struct _shard_t *shard;
+  int count, ret = 0;
+
+  // A range that crosses a boundary is stored entire in every shard that it overlaps, so the
+  // stabbing queries of any of its keys only need one shard. Clipping it would mix its pieces
+  // with the ranges that really have those limits.
+  __write_lock(me, first, last);
+  for (s = first; !ret && s <= last; s++) {
+    shard = &me->shards[s];
+    count = shard->tree->count;
+    ret = interval_tree_insert(shard->tree, r, v);
+    if (s == first)
+      shard->owned += shard->tree->count - count;
+  }
+  __write_unlock(me, first, last);
+  return ret ? -1 : 0;
+}
+
+int interval_tree_sharded_remove(interval_tree_sharded_t* me, range_t *r)
+{
+  int s, first = __shard(me, r->inf), last = __shard(me, r->sup);
+  int ret = -1;
+
+  __write_lock(me, first, last);
+  for (s = first; s <= last; s++) {
+    if (!interval_tree_remove(me->shards[s].tree, r) && s == first) {
+      me->shards[s].owned--;
+      ret = 0;
+    }
+  }
+  __write_unlock(me, first, last);
+  return ret;
+}
+
+void *interval_tree_sharded_query(interval_tree_sharded_t* me, interval_key_t k)
+{
+  struct _shard_t *shard = &me->shards[__shard(me, k)];
+  void *v;
+
+  pthread_rwlock_rdlock(&shard->lock);
+  v = interval_tree_query(shard->tree, k);
+  pthread_rwlock_unlock(&shard->lock);
+  return v;
+}
+
+int interval_tree_sharded_multiple_query_r(interval_tree_sharded_t* me, interval_key_t k, void **buf, int capacity)
+{
+  struct _shard_t *shard = &me->shards[__shard(me, k)];
+  int n;
+
+  pthread_rwlock_rdlock(&shard->lock);
+  n = interval_tree_multiple_query_r(shard->tree, k, buf, capacity);
+  pthread_rwlock_unlock(&shard->lock);
+  return n;
+}
+
+struct _sharded_overlap_t {
+  interval_tree_sharded_t *me;
+  interval_key_t inf;     /**< Lower limit of the searched range */
+  int shard;              /**< The one that is being searched */
+  interval_tree_visitor_t visitor;
+  void *user;
+  int reported;
+  int stopped;
+};
+
+/* A range overlapped by the search is stored in all the shards between its limits. It is only
+ * reported by the shard of the first key that it shares with the searched range. */
+static int __sharded_overlap_visitor(const range_t *r, void *v, void *user)
+{
+  struct _sharded_overlap_t *o = (struct _sharded_overlap_t *)user;
+
+  if (__shard(o->me, r->inf > o->inf ? r->inf : o->inf) != o->shard)
+    return 0;
+  o->reported++;
+  o->stopped = o->visitor(r, v, o->user);
+  return o->stopped;
+}
+
+int interval_tree_sharded_overlap_query_cb(interval_tree_sharded_t* me, const range_t *r, interval_tree_visitor_t visitor, void *user)
+{
+  struct _sharded_overlap_t o = { me, r->inf, 0, visitor, user, 0, 0 };
+  int last = __shard(me, r->sup);
+  struct _shard_t *shard;
+
+  for (o.shard = __shard(me, r->inf); o.shard <= last && !o.stopped; o.shard++) {
+    shard = &me->shards[o.shard];
+    pthread_rwlock_rdlock(&shard->lock);
+    interval_tree_overlap_query_cb(shard->tree, r, __sharded_overlap_visitor, &o);
+    pthread_rwlock_unlock(&shard->lock);
+  }
+  return o.reported;
+}
+
+int interval_tree_sharded_count(interval_tree_sharded_t* me)
+{
+  int i, n = 0;
+
+  for (i = 0; i < me->nshards; i++) {
+    pthread_rwlock_rdlock(&me->shards[i].lock);
+    n += me->shards[i].owned;
+    pthread_rwlock_unlock(&me->shards[i].lock);
+  }
+  return n;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file interval_tree_sharded.h
+ * Interval tree split in shards by key space, so that threads that modify different parts of
+ * the key space do not wait for each other.
+ *
+ * The key space [first, last] is divided in N consecutive shards of the same width (the keys
+ * out of it belong to the first or to the last shard). Every shard is an interval tree with
+ * its own read-write lock. A range is stored in every shard that it overlaps, so a stabbing
+ * query only locks and searches the shard of its key. Ranges that cross a boundary cost one
+ * insertion per shard.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifndef INTERVAL_TREE_SHARDED_H
+#define INTERVAL_TREE_SHARDED_H
+
+#include "interval_tree.h"
+
+typedef struct _interval_tree_sharded_t interval_tree_sharded_t; /**< Opaque structure of the tree */
+
+/**
+ * @brief Initializes an empty sharded interval tree.
+ *
+ * @param nshards Number of shards. More shards than writer threads reduce the contention.
+ * @param first First key of the key space that is divided.
+ * @param last Last key of the key space that is divided.
+ * @return NULL if the tree could not be generated.
+ */
+interval_tree_sharded_t* interval_tree_sharded_new(int nshards, interval_key_t first, interval_key_t last);
+
+/**
+ * @brief Free a previous allocated structure. No other thread can be using it.
+ *
+ * @param me The returned value by the interval_tree_sharded_new function.
+ */
+void interval_tree_sharded_free(interval_tree_sharded_t* me);
+
+/**
+ * @brief Insert a range in the tree. See interval_tree_insert. Only the shards that the range
+ * overlaps are locked, all of them until it is stored, so concurrent insertions and removals
+ * of ranges that cross boundaries take effect in the same order in every shard.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_sharded_new.
+ * @param r The interval of the node.
+ * @param v The value that the user will retrieve when a hit is produced.
+ * @return 0 on success, -1 if the memory could not be allocated. The shards before the one
+ * that failed keep the range: remove it or insert it again.
+ */
+int interval_tree_sharded_insert(interval_tree_sharded_t* me, range_t *r, void *v);
+
+/**
+ * @brief Remove a range from the tree. See interval_tree_remove. The shards are locked as in
+ * interval_tree_sharded_insert.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_sharded_new.
+ * @param r The range to remove (both limits must match).
+ * @return 0 if the range was removed, -1 if it was not in the tree.
+ */
+int interval_tree_sharded_remove(interval_tree_sharded_t* me, range_t *r);
+
+/**
+ * @brief Given an integer, check for an occurence in a range. See interval_tree_query.
+ * Only the shard of k is searched.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_sharded_new.
+ * @param k The integer to search.
+ * @return The value associated to the matched range, NULL if no occurence has appeared.
+ */
+void *interval_tree_sharded_query(interval_tree_sharded_t* me, interval_key_t k);
+
+/**
+ * @brief Find all the ranges that contain k. See interval_tree_multiple_query_r.
+ * Only the shard of k is searched.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_sharded_new.
+ * @param k The integer to search.
+ * @param buf Array that receives the values associated to the ranges that matched the key.
+ * @param capacity Number of elements of buf. The values that do not fit are not written.
+ * @return The number of ranges that matched the key.
+ */
+int interval_tree_sharded_multiple_query_r(interval_tree_sharded_t* me, interval_key_t k, void **buf, int capacity);
+
+/**
+ * @brief Report every range that overlaps r to a visitor. See interval_tree_overlap_query_cb.
+ * The shards that r overlaps are searched one after the other, and a range stored in several
+ * of them is only reported once. The visitor is invoked with the lock of a shard held, so it
+ * must not modify the tree.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_sharded_new.
+ * @param r The searched range.
+ * @param visitor The function invoked for every overlapped range.
+ * @param user The pointer that will be passed as a third argument to the visitor.
+ * @return The number of ranges reported to the visitor.
+ */
+int interval_tree_sharded_overlap_query_cb(interval_tree_sharded_t* me, const range_t *r, interval_tree_visitor_t visitor, void *user);
+
+/**
+ * @brief Number of different ranges stored in the tree.
+ *
+ * @param me A tree that has been previously allocated by a call to interval_tree_sharded_new.
+ */
+int interval_tree_sharded_count(interval_tree_sharded_t* me);
+
+#endif /* INTERVAL_TREE_SHARDED_H */
@@ -0,0 +1,225 @@
+/**
+ * @file interval_tree_snapshot.c
+ * On-disk snapshots of interval trees that are loaded with a single mmap.
+ *
+ * Layout of the file (native byte order):
+ *   struct _snapshot_header_t     64 bytes
+ *   interval_node_t[nnodes]       nodes referenced by the index
+ *   int[perm_size]                position in the AVL array -> node (-1 if empty)
+ *
+ * The pool backend (BACKEND=pool) links the nodes by their indexes, so it stores no index
+ * (perm_size is 0) and the header keeps the root instead.
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "interval_tree_private.h"
+#include "interval_tree_snapshot.h"
+
+#define SNAPSHOT_MAGIC "ITSNAP\0"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#ifdef INTERVAL_TREE_POOL
+#define SNAPSHOT_BACKEND 1
+#else
+#define SNAPSHOT_BACKEND 0
+#endif
+
+struct _snapshot_header_t {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;  /**< SNAPSHOT_BYTE_ORDER as written by the host */
+  uint32_t key_size;    /**< sizeof(interval_key_t) */
+  uint32_t node_size;   /**< sizeof(interval_node_t) */
+  uint64_t nnodes;
+  uint64_t perm_size;
+  uint64_t count;
+  uint64_t checksum;    /**< Of the nodes and the index */
+  uint32_t backend;     /**< SNAPSHOT_BACKEND of the writer */
+  int32_t root;         /**< Of the pool backend */
+};
+
+/* 64 bit multiplicative hash over the data, a word at a time */
+static uint64_t __checksum(uint64_t h, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  uint64_t w;
+
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t), p += sizeof(uint64_t)) {
+    memcpy(&w, p, sizeof(uint64_t));
+    h = (h ^ w) * 0x100000001b3ULL;
+    h ^= h >> 29;
+  }
+  for (; len; len--, p++) {
+    h = (h ^ *p) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+int interval_tree_save(interval_tree_t* me, const char *path)
+{
+  struct _snapshot_header_t h;
+  char *tmp;
+  FILE *f;
+  int i, nnodes = 0, perm_size = 0, ret = -1;
+
+#ifdef INTERVAL_TREE_POOL
+  /* The released entries are not referenced anymore, but the rest of the pool keeps its indexes */
+  nnodes = me->used;
+#endif
+  /* Holes at the end of both arrays are not stored */
+  for (i = 0; i < me->perm_size; i++) {
+    if (me->nodes_perm[i] >= 0) {
+      perm_size = i + 1;
+      if (me->nodes_perm[i] >= nnodes)
+        nnodes = me->nodes_perm[i] + 1;
+    }
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+  h.version = INTERVAL_TREE_SNAPSHOT_VERSION;
+  h.byte_order = SNAPSHOT_BYTE_ORDER;
+  h.key_size = sizeof(interval_key_t);
+  h.node_size = sizeof(interval_node_t);
+  h.nnodes = nnodes;
+  h.perm_size = perm_size;
+  h.count = me->count;
+  h.backend = SNAPSHOT_BACKEND;
+#ifdef INTERVAL_TREE_POOL
+  h.root = me->root;
+#endif
+  h.checksum = __checksum(0xcbf29ce484222325ULL, me->nodes, nnodes * sizeof(interval_node_t));
+  h.checksum = __checksum(h.checksum, me->nodes_perm, perm_size * sizeof(int));
+
+  tmp = malloc(strlen(path) + sizeof(".tmp"));
+  if (!tmp) return -1;
+  sprintf(tmp, "%s.tmp", path);
+
+  f = fopen(tmp, "wb");
+  if (!f) goto out;
+  if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+      fwrite(me->nodes, sizeof(interval_node_t), nnodes, f) != (size_t) nnodes ||
+      (perm_size && fwrite(me->nodes_perm, sizeof(int), perm_size, f) != (size_t) perm_size) ||
+      fflush(f) || fsync(fileno(f))) {
+    fclose(f);
+    unlink(tmp);
+    goto out;
+  }
+  if (fclose(f) || rename(tmp, path)) {
+    unlink(tmp);
+    goto out;
+  }
+  ret = 0;
+
+out:
+  free(tmp);
+  return ret;
+}
+
+interval_tree_t* interval_tree_open_mmap(const char *path)
+{
+  interval_tree_t* me;
+  struct _snapshot_header_t *h;
+  struct stat st;
+  void *map;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) || st.st_size < (off_t) sizeof(struct _snapshot_header_t)) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+
+  h = map;
+  if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) ||
+      h->version != INTERVAL_TREE_SNAPSHOT_VERSION ||
+      h->byte_order != SNAPSHOT_BYTE_ORDER ||
+      h->key_size != sizeof(interval_key_t) ||
+      h->node_size != sizeof(interval_node_t) ||
+      h->backend != SNAPSHOT_BACKEND ||
+      h->root < -1 || h->root >= (int64_t) h->nnodes ||
+      h->nnodes > INT_MAX || h->perm_size > INT_MAX || h->count > h->nnodes ||
+      (uint64_t) st.st_size != sizeof(*h) + h->nnodes * sizeof(interval_node_t) + h->perm_size * sizeof(int)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  me = calloc(1, sizeof(interval_tree_t));
+  if (!me || !(me->multiple_query_return = calloc(h->nnodes + 1, sizeof(void *)))) {
+    free(me);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  me->allocator = __interval_tree_default_allocator;
+  me->map = map;
+  me->map_size = st.st_size;
+  me->nodes = (interval_node_t *) (h + 1);
+  me->nodes_perm = (int *) (me->nodes + h->nnodes);
+  me->size = h->nnodes;
+  me->used = h->nnodes;
+  me->perm_size = h->perm_size;
+  me->count = h->count;
+#ifdef INTERVAL_TREE_POOL
+  me->root = h->root;
+#endif
+  return me;
+}
+
+#ifdef INTERVAL_TREE_POOL
+/* Every index must be inside the pool and the tree cannot be deeper than an AVL tree (which
+ * also rejects cycles) */
+static int __verify(interval_tree_t* me, int pos, int depth, int *count)
+{
+  if (pos < -1 || pos >= me->size || depth > INTERVAL_TREE_MAX_DEPTH)
+    return -1;
+  if (pos < 0)
+    return 0;
+  if (++(*count) > me->count)
+    return -1;
+  if (__verify(me, me->nodes[pos].left, depth + 1, count))
+    return -1;
+  return __verify(me, me->nodes[pos].right, depth + 1, count);
+}
+#endif
+
+int interval_tree_snapshot_verify(interval_tree_t* me)
+{
+  struct _snapshot_header_t *h = me->map;
+  uint64_t checksum;
+  int count = 0;
+#ifndef INTERVAL_TREE_POOL
+  int i;
+#endif
+
+  if (!h) return -1;
+
+  checksum = __checksum(0xcbf29ce484222325ULL, me->nodes, me->size * sizeof(interval_node_t));
+  checksum = __checksum(checksum, me->nodes_perm, me->perm_size * sizeof(int));
+  if (checksum != h->checksum)
+    return -1;
+
+#ifdef INTERVAL_TREE_POOL
+  if (__verify(me, me->root, 0, &count))
+    return -1;
+#else
+  for (i = 0; i < me->perm_size; i++) {
+    if (me->nodes_perm[i] < -1 || me->nodes_perm[i] >= me->size)
+      return -1;
+    count += me->nodes_perm[i] >= 0;
+  }
+#endif
+  return count == me->count ? 0 : -1;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file interval_tree_snapshot.h
+ * On-disk snapshots of interval trees that are loaded with a single mmap.
+ *
+ * A snapshot is a header followed by the node array of the tree and by the index of the
+ * implicit heap (position in the AVL array -> node). Neither of them contains pointers, so
+ * the file is used in place: opening it costs a system call whatever its size, pages are read
+ * on demand and every process that maps the same file shares one copy in the page cache.
+ *
+ * The values of the ranges are stored as integers (their uintptr_t representation), so they
+ * must be integer payloads or offsets that mean the same in every process, never pointers
+ * to memory. Snapshots are only valid in hosts with the same byte order and pointer width,
+ * and for programs compiled with the same key type (see INTERVAL_TREE_KEY128).
+ *
+ * @author Jose Fernando Zazo (www.github.com/jfzazo)
+ * @date 16/10/2026
+ */
+#ifndef INTERVAL_TREE_SNAPSHOT_H
+#define INTERVAL_TREE_SNAPSHOT_H
+
+#include "interval_tree.h"
+
+#define INTERVAL_TREE_SNAPSHOT_VERSION 3
+
+/**
+ * @brief Write a snapshot of the tree. The file is written under a temporary name and renamed,
+ * so processes that have the previous version mapped keep working with it.
+ *
+ * @param me A interval tree (it can also be a tree opened by interval_tree_open_mmap).
+ * @param path Name of the file.
+ * @return 0 on success, -1 on error (errno describes it).
+ */
+int interval_tree_save(interval_tree_t* me, const char *path);
+
+/**
+ * @brief Map a snapshot written by interval_tree_save. Only the header is checked, use
+ * interval_tree_snapshot_verify to check the whole content.
+ * The returned tree is read-only: every query function can be used, but it cannot be
+ * modified. It is released with interval_tree_free, which unmaps the file.
+ *
+ * @param path Name of the file.
+ * @return NULL if the file could not be mapped or it is not a valid snapshot for this program.
+ */
+interval_tree_t* interval_tree_open_mmap(const char *path);
+
+/**
+ * @brief Check the checksum and the consistency of a tree opened by interval_tree_open_mmap.
+ * It reads the whole file.
+ *
+ * @param me A tree returned by interval_tree_open_mmap.
+ * @return 0 if the snapshot is valid, -1 otherwise.
+ */
+int interval_tree_snapshot_verify(interval_tree_t* me);
+
+#endif /* INTERVAL_TREE_SNAPSHOT_H */